@@ -46,7 +46,36 @@
 
 #include "Arduino.h"
 #include "Sim800L.h"
+#include "Sim800LCommand.h"
 #include <SoftwareSerial.h>
+#if defined(__AVR__)
+#include <avr/sleep.h>
+#endif
+
+// Maximum response time of each CommandType, from the datasheet
+static const uint32_t maxTimeouts[commandTypeCount] PROGMEM = {
+    TIME_OUT_READ_SERIAL,	// commandGeneric
+    10000,					// commandPin
+    60000,					// commandSmsSend
+    25000,					// commandSmsDelete
+    45000,					// commandNetworkScan
+    60000,					// commandNetworkSelect
+    20000,					// commandLocation
+    85000,					// commandBearer
+};
+
+// Floor of the learned timeouts. AT+CMGS is not learned at all: after a
+// timeout the sms would be sent again while the first one may still go out.
+static const uint32_t minTimeouts[commandTypeCount] PROGMEM = {
+    1000,					// commandGeneric
+    2000,					// commandPin
+    60000,					// commandSmsSend
+    2000,					// commandSmsDelete
+    5000,					// commandNetworkScan
+    5000,					// commandNetworkSelect
+    2000,					// commandLocation
+    2000,					// commandBearer
+};
 
 //SoftwareSerial SIM(RX_PIN,TX_PIN);
 //String _buffer;
@@ -89,24 +118,13 @@ Sim800L::Sim800L(uint8_t rx, uint8_t tx, uint8_t rst, uint8_t led) : SoftwareSer
 
 void Sim800L::begin()
 {
-
-    isBusy = false;
-    pinMode(RESET_PIN, OUTPUT);
-
-    _baud = DEFAULT_BAUD_RATE;			// Default baud rate 9600
-    this->SoftwareSerial::begin(_baud);
-
-    _sleepMode = 0;
-    _functionalityMode = 1;
-
-    if (LED_FLAG) pinMode(LED_PIN, OUTPUT);
-
-    _buffer.reserve(BUFFER_RESERVE_MEMORY); // Reserve memory to prevent intern fragmention
+    begin(DEFAULT_BAUD_RATE);			// Default baud rate 9600
 }
 
 void Sim800L::begin(uint32_t baud)
 {
 
+    isBusy = false;
     pinMode(RESET_PIN, OUTPUT);
 
     _baud = baud;
@@ -114,10 +132,92 @@ void Sim800L::begin(uint32_t baud)
 
     _sleepMode = 0;
     _functionalityMode = 1;
+    _idleSleep = false;
+
+#if SIM800L_ENABLE_CALL
+    _callState = callIdle;
+    _callerIdEnabled = false;
+#endif
+
+#if SIM800L_ENABLE_USSD
+    _ussdStatus = ussdDone;
+    _ussdCancel = false;
+#endif
+
+#if SIM800L_ENABLE_DTMF
+    _dtmfEnabled = false;
+    _dtmfMenu = NULL;
+    _dtmfMenuCount = 0;
+    _dtmfState = DTMF_MENU_START;
+    _dtmfTimeout = 0;
+#endif
+
+    // Silence of 20 characters ends an answer
+    _idleGap = 200000 / _baud;
+    if (_idleGap < 5) _idleGap = 5;
+    _rxOverflowCount = 0;
+    _lastReadOverflowed = false;
+    _compactMode = false;
+    _lastError = errorNone;
+    _lastErrorCode = 0;
+    _timeOuts = 0;
+    _bearerActive = false;
+
+#if SIM800L_ENABLE_FTP
+    _ftpStatus = FTP_STATUS_NONE;
+    _ftpMaxLength = FTP_CHUNK_SIZE;
+#endif
+
+#if SIM800L_ENABLE_WATCHDOG
+    _watchdogInterval = 0;
+    _powerDown = false;
+    _recovering = false;
+    _recoveries = 0;
+#endif
+
+#if SIM800L_ENABLE_CELL
+    memset(&_servingCell, 0, sizeof(_servingCell));
+    _neighbourCount = 0;
+    _cellSampleTime = 0;
+    _cellInterval = 0;
+#endif
+
+#if SIM800L_ENABLE_SIGNAL_LOG
+    _signalLog = NULL;
+    _signalLogInterval = 0;
+#endif
+
+#if SIM800L_ENABLE_SMS
+    _smsUsed = 0;
+    _smsTotal = 0;
+    _deleteAfterRead = false;
+    _smsAutoCleanup = false;
+    _savedSmsMode = SMS_MODE_UNSET;
+    _smsDelivery = SMS_MODE_UNSET;
+    _smsBodyPending = false;
+    _statusReportPending = false;
+    _smsUrcsParsed = false;
+    _smsNumber[0] = '\0';
+    _smsTime[0] = '\0';
+    _smsHeader.number = _smsNumber;
+    _smsHeader.timestamp = _smsTime;
+
+    _deliveryTimeout = DELIVERY_TIME_OUT;
+    for (uint8_t i = 0; i < DELIVERY_TABLE_SIZE; i++) _deliveries[i].reference = DELIVERY_FREE;
+#endif
 
     if (LED_FLAG) pinMode(LED_PIN, OUTPUT);
 
     _buffer.reserve(BUFFER_RESERVE_MEMORY); // Reserve memory to prevent intern fragmention
+    _urcLine.reserve(URC_LINE_MAX_LENGTH);
+    _commandResponse.reserve(COMMAND_RESPONSE_RESERVE);
+
+    _commandOwner = NULL;
+    _commandStatus = commandIdle;
+    _polling = false;
+    for (uint8_t i = 0; i < commandTypeCount; i++) _latencySamples[i] = 0;
+    _smsReady = false;
+    for (uint8_t i = 0; i < taskCount; i++) _tasks[i].running = false;
 }
 
 
@@ -133,7 +233,7 @@ bool Sim800L::setSleepMode(bool state)
     if (_sleepMode) this->SoftwareSerial::print(F("AT+CSCLK=1\r\n "));
     else 			this->SoftwareSerial::print(F("AT+CSCLK=0\r\n "));
 
-    if ( (_readSerial().indexOf("ER")) == -1)
+    if ( !_isError(_readSerial()))
     {
         return false;
     }
@@ -173,7 +273,7 @@ bool Sim800L::setFunctionalityMode(uint8_t fun)
             break;
         }
 
-        if ( (_readSerial().indexOf("ER")) == -1)
+        if ( !_isError(_readSerial()))
         {
             return false;
         }
@@ -189,6 +289,71 @@ uint8_t Sim800L::getFunctionalityMode()
     return _functionalityMode;
 }
 
+/*
+ * ATE0	Echo off, the module no longer repeats every command
+ * ATV0	Result codes as digits: 0 OK, 2 RING, 3 NO CARRIER, 4 ERROR, 7 BUSY, 8 NO ANSWER
+ * AT+CMEE=1	Numeric +CME ERROR: <err> instead of a bare ERROR
+ * ATE1V1 restores the default verbose link.
+ */
+bool Sim800L::setCompactMode(bool state)
+{
+    if (state) this->SoftwareSerial::print(F("ATE0V0+CMEE=1\r"));
+    else 		this->SoftwareSerial::print(F("ATE1V1\r"));
+
+    // The answer already comes in the new format
+    _compactMode = state;
+    if (!_isOk(_readSerial()))
+    {
+        _compactMode = !state;
+        return false;
+    }
+    return true;
+}
+
+bool Sim800L::getCompactMode()
+{
+    return _compactMode;
+}
+
+/*
+ * AT+CMEE=0	Disable result code, only ERROR
+ * AT+CMEE=1	Enable +CME ERROR: <err> result code and use numeric <err> values
+ * reset() enables it.
+ */
+bool Sim800L::setErrorCodes(bool state)
+{
+    if (state) this->SoftwareSerial::print(F("AT+CMEE=1\r"));
+    else 		this->SoftwareSerial::print(F("AT+CMEE=0\r"));
+
+    return _isOk(_readSerial());
+}
+
+/*
+ * Outcome of the last command: errorNone, errorTimeout, a bare ERROR or the
+ * +CME/+CMS code, whatever the legacy return value of the method says
+ */
+ModemError Sim800L::getLastError()
+{
+    return _lastError;
+}
+
+uint16_t Sim800L::getLastErrorCode()
+{
+    return _lastErrorCode;
+}
+
+// A busy SIM or a missing network may go away, retrying is worth it
+bool Sim800L::isErrorTransient()
+{
+    if (_lastError == errorTimeout) return true;
+    if (_lastError == errorEquipment)
+        return _lastErrorCode == CME_SIM_BUSY || _lastErrorCode == CME_NO_NETWORK || _lastErrorCode == CME_NETWORK_TIME_OUT;
+    if (_lastError == errorMessage)
+        return _lastErrorCode == CMS_SIM_BUSY || _lastErrorCode == CMS_NO_NETWORK || _lastErrorCode == CMS_NETWORK_TIME_OUT;
+    return false;
+}
+
+#if SIM800L_ENABLE_PIN
 bool Sim800L::setPIN(String pin)
 {
     String command;
@@ -205,15 +370,16 @@ bool Sim800L::setPIN(String pin)
     int indexOfAnswer = -1;
     while (indexOfAnswer == -1)
     {
-        pinStatus = _readSerial(10000);
-        if(pinStatus.indexOf("ERR") != -1)
+        pinStatus = _readSerial(commandPin);
+        if(_isError(pinStatus))
         {
             Serial.println(pinStatus);
             return false;
         }
-        if(pinStatus.indexOf("OK") != -1)
+        if(_isOk(pinStatus))
         {
             Serial.println(pinStatus);
+            _savedPin = pin;
             return true;
         }
     }
@@ -233,16 +399,10 @@ bool Sim800L::PINIsReady()
 
     this->SoftwareSerial::print(command);
     
-    int indexOfAnswer = -1;
     String pinStatus = ""; 
-    while (indexOfAnswer == -1)
+    while (!_isError(pinStatus) && !_isOk(pinStatus))
     {
-        pinStatus = _readSerial(10000);
-        indexOfAnswer = pinStatus.indexOf("ERR");
-        if(indexOfAnswer == -1)
-        {
-            indexOfAnswer = pinStatus.indexOf("OK");
-        }
+        pinStatus = _readSerial(commandPin);
     }
     
     if ( pinStatus.indexOf("CPIN: READY") != -1)
@@ -266,10 +426,10 @@ bool Sim800L::disablePin(String pin)
 
         this->SoftwareSerial::print(command);
 
-        String pinStatus = _readSerial(10000);
+        String pinStatus = _readSerial(commandPin);
 
         Serial.println(pinStatus);
-        if(pinStatus.indexOf("OK") != -1)
+        if(_isOk(pinStatus))
         {
             return true;
         }
@@ -279,14 +439,16 @@ bool Sim800L::disablePin(String pin)
     return false;
 
 }
+#endif
 
 String Sim800L::getProductInfo()
 {
     this->SoftwareSerial::print("ATI\r");
-    return (_readSerial());
+    return (_readSerial(commandGeneric));
 }
 
 
+#if SIM800L_ENABLE_OPERATOR
 String Sim800L::getOperatorsList()
 {
 
@@ -294,8 +456,59 @@ String Sim800L::getOperatorsList()
 
     this->SoftwareSerial::print("AT+COPS=?\r");
 
-    return _readSerial(45000);
+    return _readSerial(commandNetworkScan);
+
+}
+
+/*
+ * Streaming version of getOperatorsList(): every operator of the AT+COPS=?
+ * answer is passed to callback as soon as its tuple is received
+ *   (stat,"long","short","numeric")
+ * so the whole answer is never kept in RAM.
+ * Return true if the scan ended with OK.
+ */
+bool Sim800L::getOperatorsList(void (*callback)(const OperatorInfo &info))
+{
+    _operatorCallback = callback;
+    _operatorAllowed = NULL;
+    _operatorAllowedCount = 0;
+    _bestOperator.status = operatorUnknown;
+
+    return _scanOperators();
+}
+
+/*
+ * Scan the operators and register to the best one: the current one if it is
+ * still allowed, otherwise the first available one. AT+COPS=? does not report
+ * the signal strength, the module lists the operators in the order found.
+ * allowed: optional list of numeric codes ("22201"...) the choice is limited to.
+ */
+bool Sim800L::selectBestOperator(const char *const *allowed, uint8_t count)
+{
+    _operatorCallback = NULL;
+    _operatorAllowed = allowed;
+    _operatorAllowedCount = count;
+    _bestOperator.status = operatorUnknown;
+
+    if (!_scanOperators() || _bestOperator.status == operatorUnknown)
+    {
+        return false;
+    }
+
+    // Can take up to 60 seconds
+
+    Sim800LCommand command(*this);
+    command.print(F("AT+COPS=1,2,\""));
+    command.print(_bestOperator.numeric);
+    command.print(F("\"\r"));
+    command.send();
 
+    _buffer=_readSerial(commandNetworkSelect);
+    if (!_isOk(_buffer))
+    {
+        return false;
+    }
+    return true;
 }
 
 String Sim800L::getOperator()
@@ -325,12 +538,13 @@ String Sim800L::getOperator()
     return _readSerial();
 
 }
+#endif
 
 bool Sim800L::registerToNetwork()
 {
     this->SoftwareSerial::print("AT+CREG=1\r");
 
-    if ( (_readSerial(5000).indexOf("OK")) == -1)
+    if ( !_isOk(_readSerial(5000)))
     {
         return true;
     }
@@ -342,7 +556,7 @@ NetworkRegistrationStatus Sim800L::registrationStatus()
 {
     this->SoftwareSerial::print("AT+CREG ?\r");
 
-    String status = _readSerial(); 
+    String status = _readSerial(commandGeneric);
     
    if(status.indexOf("CREG: 0,1") > -1)
     {
@@ -393,6 +607,7 @@ NetworkRegistrationStatus Sim800L::registrationStatus()
 }
 
 
+#if SIM800L_ENABLE_LOCATION
 bool Sim800L::calculateLocation()
 {
     /*
@@ -402,21 +617,18 @@ bool Sim800L::calculateLocation()
 
     uint8_t type = 1;
     uint8_t cid = 1;
-	
-	String tmp = "AT+CIPGSMLOC=" + String(type) + "," + String(cid) + "\r\n";
-	this->SoftwareSerial::print(tmp);
-	
-	/*
-    this->SoftwareSerial::print("AT+CIPGSMLOC=");
-    this->SoftwareSerial::print(type);
-    this->SoftwareSerial::print(",");
-    this->SoftwareSerial::print(cid);
-    this->SoftwareSerial::print("\r");
-	*/
-
-    String data = _readSerial(20000);
-
-    if (data.indexOf("ER")!=(-1)) return false;
+
+    Sim800LCommand command(*this);
+    command.print(F("AT+CIPGSMLOC="));
+    command.print(type);
+    command.print(',');
+    command.print(cid);
+    command.print(F("\r\n"));
+    command.send();
+
+    String data = _readSerial(commandLocation);
+
+    if (_isError(data)) return false;
 
     uint8_t indexOne;
     uint8_t indexTwo;
@@ -465,7 +677,7 @@ String Sim800L::getLatitude()
 {
     return _latitude;
 }
-
+#endif
 
 //
 //PUBLIC METHODS
@@ -476,19 +688,26 @@ void Sim800L::reset()
     if (LED_FLAG) digitalWrite(LED_PIN,1);
 
     digitalWrite(RESET_PIN,1);
-    delay(1000);
+    _delay(1000);
     digitalWrite(RESET_PIN,0);
-    delay(1000);
+    _delay(1000);
+    // the module restarts with echo and verbose result codes
+    _compactMode = false;
     // wait for the module response
 
+    // a module that never answers must not hang the sketch
+    uint8_t retries = 0;
     this->SoftwareSerial::print(F("AT\r\n"));
-    while (_readSerial().indexOf("OK")==-1 )
+    while (!_isOk(_readSerial(commandGeneric)) && ++retries < RESET_RETRIES)
     {
         this->SoftwareSerial::print(F("AT\r\n"));
     }
 
     //wait for sms ready
-    while (_readSerial().indexOf("SMS")==-1 );
+    uint32_t timeOld = millis();
+    while (_readSerial().indexOf("SMS")==-1 && millis() - timeOld < BOOT_TIME_OUT);
+
+    setErrorCodes(true);
 
     if (LED_FLAG) digitalWrite(LED_PIN,0);
 
@@ -523,8 +742,139 @@ String Sim800L::signalQuality()
     99 Not known or not detectable
     */
     this->SoftwareSerial::print (F("AT+CSQ\r\n"));
-    return(_readSerial());
+    return(_readSerial(commandGeneric));
+}
+
+#if SIM800L_ENABLE_CELL || SIM800L_ENABLE_SIGNAL_LOG
+// Value of the n-th comma separated field starting at from
+static uint16_t cellField(const String &data, int from, uint8_t n, uint8_t base)
+{
+    while (n-- > 0)
+    {
+        from = data.indexOf(',', from) + 1;
+        if (from == 0) return 0;
+    }
+    return strtol(data.c_str() + from, NULL, base);
+}
+
+#endif
+
+#if SIM800L_ENABLE_CELL
+/*
+ * AT+CENG=1,1	Switch on engineering mode, with cell id and lac of the neighbours
+ * AT+CENG?	Report of the serving cell and of the neighbours:
+ * +CENG: 0,"<arfcn>,<rxl>,<rxq>,<mcc>,<mnc>,<bsic>,<cellid>,<rla>,<txp>,<lac>,<TA>"
+ * +CENG: 1,"<arfcn>,<rxl>,<bsic>,<cellid>,<mcc>,<mnc>,<lac>"
+ * ...
+ */
+bool Sim800L::readCellInfo()
+{
+    this->SoftwareSerial::print(F("AT+CENG=1,1\r"));
+    if (!_isOk(_readSerial()))
+    {
+        return false;
+    }
+
+    this->SoftwareSerial::print(F("AT+CENG?\r"));
+    _buffer=_readSerial();
+    if (!_isOk(_buffer))
+    {
+        return false;
+    }
+
+    _parseCellInfo(_buffer);
+    return true;
+}
+
+/*
+ * Sample the cells every interval ms from poll(), 0 stops the sampling and
+ * the engineering mode. onCellInfo is called after each sample.
+ */
+bool Sim800L::setCellMonitoring(uint32_t interval)
+{
+    _cellInterval = interval;
+    if (interval == 0 || isTaskRunning(taskCellMonitor)) return true;
+    return _startTask(taskCellMonitor);
+}
+
+const CellInfo &Sim800L::getServingCell()
+{
+    return _servingCell;
+}
+
+uint8_t Sim800L::getNeighbourCount()
+{
+    return _neighbourCount;
+}
+
+const CellInfo &Sim800L::getNeighbourCell(uint8_t index)
+{
+    if (index >= CELL_NEIGHBOURS) index = CELL_NEIGHBOURS - 1;
+    return _neighbourCells[index];
+}
+
+// millis() of the last sample, 0 if none yet
+uint32_t Sim800L::getCellSampleTime()
+{
+    return _cellSampleTime;
+}
+
+void Sim800L::_parseCellInfo(const String &data)
+{
+    uint8_t neighbours = 0;
+    int start = data.indexOf(F("+CENG:"));
+
+    while (start != -1)
+    {
+        int quote = data.indexOf('"', start);
+        int next = data.indexOf(F("+CENG:"), start + 1);
+
+        // +CENG: 1,1 (mode and neighbours) has no quoted data
+        if (quote != -1 && (next == -1 || quote < next))
+        {
+            quote++;
+            if (data.substring(start + 6, quote).toInt() == 0)
+            {
+                _servingCell.arfcn = cellField(data, quote, 0, 10);
+                _servingCell.rxLevel = cellField(data, quote, 1, 10);
+                _servingCell.bsic = cellField(data, quote, 5, 10);
+                _servingCell.cellId = cellField(data, quote, 6, 16);
+                _servingCell.lac = cellField(data, quote, 9, 16);
+            }
+            else if (neighbours < CELL_NEIGHBOURS)
+            {
+                CellInfo &cell = _neighbourCells[neighbours];
+                cell.arfcn = cellField(data, quote, 0, 10);
+                cell.rxLevel = cellField(data, quote, 1, 10);
+                cell.bsic = cellField(data, quote, 2, 10);
+                cell.cellId = cellField(data, quote, 3, 16);
+                cell.lac = cellField(data, quote, 6, 16);
+                // Unused entries are reported with a null or ffff cell id
+                if (cell.cellId != 0 && cell.cellId != 0xFFFF) neighbours++;
+            }
+        }
+        start = next;
+    }
+
+    _neighbourCount = neighbours;
+    _cellSampleTime = millis();
+    if (onCellInfo != NULL) onCellInfo(_servingCell, _neighbourCells, _neighbourCount);
 }
+#endif
+
+#if SIM800L_ENABLE_SIGNAL_LOG
+/*
+ * Add a sample of AT+CSQ and AT+CREG? to log every interval ms from poll(),
+ * 0 or a NULL log stops the sampling.
+ */
+bool Sim800L::setSignalLog(Sim800LSignalLog *log, uint32_t interval)
+{
+    _signalLog = log;
+    _signalLogInterval = log == NULL ? 0 : interval;
+    if (_signalLogInterval == 0 || isTaskRunning(taskSignalLog)) return true;
+    return _startTask(taskSignalLog);
+}
+#endif
 
 
 void Sim800L::activateBearerProfile()
@@ -534,28 +884,32 @@ void Sim800L::activateBearerProfile()
     this->SoftwareSerial::print (F(" AT+SAPBR=3,1,\"APN\",\"internet\" \r\n" ));
     _buffer=_readSerial();  // set apn
     this->SoftwareSerial::print (F(" AT+SAPBR=1,1 \r\n"));
-    delay(1200);
+    _delay(1200);
     _buffer=_readSerial();			// activate bearer context
     this->SoftwareSerial::print (F(" AT+SAPBR=2,1\r\n "));
-    delay(3000);
+    _delay(3000);
     _buffer=_readSerial(); 			// get context ip address
+    _bearerActive = true;
 }
 
 
 void Sim800L::deactivateBearerProfile()
 {
     this->SoftwareSerial::print (F("AT+SAPBR=0,1\r\n "));
-    delay(1500);
+    _delay(1500);
+    _bearerActive = false;
 }
 
 
 
+#if SIM800L_ENABLE_CALL
 bool Sim800L::answerCall()
 {
     this->SoftwareSerial::print (F("ATA\r\n"));
     //Response in case of data call, if successfully connected
-    if ( (_readSerial().indexOf("ER")) == -1)
+    if ( !_isError(_readSerial()))
     {
+        _setCallState(callActive);
         return false;
     }
     else return true;
@@ -566,9 +920,15 @@ bool Sim800L::answerCall()
 
 void  Sim800L::callNumber(char* number)
 {
-    this->SoftwareSerial::print (F("ATD"));
-    this->SoftwareSerial::print (number);
-    this->SoftwareSerial::print (F(";\r\n"));
+    Sim800LCommand command(*this);
+    command.print (F("ATD"));
+    command.print (number);
+    command.print (F(";\r\n"));
+    command.send();
+
+    // The outcome arrives later as +COLP, BUSY, NO ANSWER or NO CARRIER,
+    // it is reported by poll() through onCallResult.
+    _setCallState(callDialing);
 }
 
 
@@ -596,8 +956,9 @@ bool Sim800L::hangoffCall()
 {
     this->SoftwareSerial::print (F("ATH\r\n"));
     _buffer=_readSerial();
-    if ( (_buffer.indexOf("ER")) == -1)
+    if ( !_isError(_buffer))
     {
+        _setCallState(callIdle);
         return false;
     }
     else return true;
@@ -605,459 +966,2790 @@ bool Sim800L::hangoffCall()
     // Error NOT found, return 0
 }
 
-int Sim800L::sendSms(String pdu)
+/*
+ * AT+CLIP=1	Report the caller number with +CLIP after every RING
+ * AT+COLP=1	Report +COLP when the called party answers an ATD
+ */
+bool Sim800L::prepareForCallEvents()
 {
-    int pduLength = (pdu.length() / 2)-1;
-
-    if(pduLength < 10 || isBusy)
+    this->SoftwareSerial::print(F("AT+CLIP=1\r"));
+    _buffer=_readSerial();
+    if(!_isOk(_buffer))
     {
-        // Bad Pdu
-        return -4;
-    }
-
-    isBusy = true;
-    this->SoftwareSerial::print (F("AT+CMGS="));  	// command to send sms
-    this->SoftwareSerial::print (pduLength);
-    this->SoftwareSerial::println();
-    _buffer=_readSerial(100);
-    this->SoftwareSerial::print (pdu);
-    _buffer=_readSerial(100);
-    this->SoftwareSerial::write(0x1a); // Ctrl+Z end of the message
-    _buffer=_readSerial(60000);
-    
-    //expect CMGS:xxx   , where xxx is a number,for the sending sms.
-    if ((_buffer.indexOf(F("ERROR"))) != -1) {
-        isBusy = false;
-        return -2;
+        return false;
     }
-    
-    if ((_buffer.indexOf(F("CMGS"))) < 0) {
-        isBusy = false;
-        return -3;
-  	}
-    
-    int indexOfTwoDots = _buffer.indexOf(':');
+    _callerIdEnabled = true;
 
-    isBusy = false;
-
-    if(indexOfTwoDots == -1)
+    this->SoftwareSerial::print(F("AT+COLP=1\r"));
+    _buffer=_readSerial();
+    if(!_isOk(_buffer))
     {
-        return -1;
+        return false;
     }
-
-    return (_buffer.substring(indexOfTwoDots+1)).toInt();
-
+    return true;
 }
 
-bool Sim800L::sendSms(char* number,char* text)
+CallState Sim800L::getCallState()
 {
+    return _callState;
+}
 
-    // Can take up to 60 seconds
-
-    this->SoftwareSerial::print (F("AT+CMGF=1\r")); 	//set sms to text mode
-    _buffer=_readSerial();
-    this->SoftwareSerial::print (F("AT+CMGS=\""));  	// command to send sms
-    this->SoftwareSerial::print (number);
-    this->SoftwareSerial::print(F("\"\r"));
-    _buffer=_readSerial();
-    this->SoftwareSerial::print (text);
-    this->SoftwareSerial::print (F("\r"));
-    _buffer=_readSerial();
-    this->SoftwareSerial::print((char)26);
-    _buffer=_readSerial(60000);
-    // Serial.println(_buffer);
-    //expect CMGS:xxx   , where xxx is a number,for the sending sms.
-    if ((_buffer.indexOf(F("ER"))) != -1) {
-        return true;
-    } else if ((_buffer.indexOf(F("CMGS"))) != -1) {
-        return false;
-  	} else {
-    	return true;
-  	}
-    // Error found, return 1
-    // Error NOT found, return 0
+String Sim800L::getCallerNumber()
+{
+    return _callerNumber;
 }
+#endif
 
-bool Sim800L::setPduMode()
+#if SIM800L_ENABLE_DTMF
+/*
+ * AT+DDET=1	Report the keys pressed by the remote party with +DTMF: <key>
+ */
+bool Sim800L::setDtmfDetection(bool state)
 {
-	this->SoftwareSerial::print(F("AT+CMGF=0\r"));
-    _buffer=_readSerial();
-    
-    if((_buffer.indexOf(F("OK"))) == -1)
+    if (state) this->SoftwareSerial::print(F("AT+DDET=1\r"));
+    else this->SoftwareSerial::print(F("AT+DDET=0\r"));
+
+    if (!_isOk(_readSerial()))
     {
         return false;
     }
-
+    _dtmfEnabled = state;
     return true;
 }
 
-bool Sim800L::setTextMode()
+/*
+ * Keypad menu run on the keys of a connected call. The first entry with the
+ * current state and the key (or DTMF_KEY_ANY) moves to its next state and
+ * calls onDtmfMenu(action, key) when action is not 0. Without a key for
+ * timeout ms, DTMF_KEY_TIME_OUT is looked up the same way; 0 disables it.
+ * Every call starts from DTMF_MENU_START, a NULL menu stops it.
+ */
+void Sim800L::setDtmfMenu(const DtmfMenuEntry *menu, uint8_t count, uint32_t timeout)
 {
-	this->SoftwareSerial::print(F("AT+CMGF=1\r"));
-    _buffer=_readSerial();
-    Serial.print(_buffer);
-    if((_buffer.indexOf(F("OK"))) == -1)
-    {
-        return false;
-    }
+    _dtmfMenu = menu;
+    _dtmfMenuCount = menu == NULL ? 0 : count;
+    _dtmfTimeout = timeout;
+    _dtmfState = DTMF_MENU_START;
+    _dtmfTime = millis();
+}
 
-    return true;
+uint8_t Sim800L::getDtmfState()
+{
+    return _dtmfState;
 }
+#endif
 
-bool Sim800L::prepareForSmsReceive()
+#if SIM800L_ENABLE_USSD
+/*
+ * AT+CUSD=1,"<code>"	Send a USSD code, or the reply to a menu, from poll().
+ * The answer comes later with +CUSD: <status>,"<text>",<dcs> and is passed,
+ * decoded, to onUssd(status, text). Returns false if a request is running.
+ */
+bool Sim800L::sendUssd(const char *code)
 {
-	
-	this->SoftwareSerial::print(F("AT+CNMI=2,2,0,1,0\r")); // 2,1,0,1,0 Active Ds mode (Data report)
-    _buffer=_readSerial();
-    //Serial.print(_buffer);
-    if((_buffer.indexOf(F("OK"))) == -1)
+    if (isTaskRunning(taskUssd)) return false;
+    _ussdText = code;
+    _ussdCancel = false;
+    return _startTask(taskUssd);
+}
+
+/*
+ * AT+CUSD=2	End the session, also while waiting for an answer
+ */
+bool Sim800L::cancelUssd()
+{
+    _ussdCancel = true;
+    if (isTaskRunning(taskUssd)) return true;
+    return _startTask(taskUssd);
+}
+
+UssdStatus Sim800L::getUssdStatus()
+{
+    return _ussdStatus;
+}
+
+const String &Sim800L::getUssdText()
+{
+    return _ussdText;
+}
+#endif
+
+#if SIM800L_ENABLE_USSD
+// An odd number of quotes, the line goes on
+bool Sim800L::_quoteOpen(const String &line)
+{
+    bool open = false;
+    for (unsigned int i = 0; i < line.length(); i++)
     {
-        return false;
+        if (line[i] == '"') open = !open;
     }
-    return true;
+    return open;
 }
+#endif
 
-void Sim800L::checkForGsmMessage()
+/*
+ * Non blocking: consume whatever the module has sent so far and dispatch
+ * every complete unsolicited line (RING, +CLIP, NO CARRIER...).
+ * Call it from loop(), it returns true if at least one event was handled.
+ */
+bool Sim800L::poll()
 {
-	 _buffer = _readSerial(100);
-	 if(_buffer.length() == 0)
-	 {
-        return ;
-	 	//return 0;
-	 }
-     _buffer += _readSerial(5000);
-   /*  Serial.println("checkForSMS");
-
-	 Serial.println(_buffer);
-     
-	 Serial.println("-----------------");*/
+    bool handled = false;
 
-    int indexOfCds = _buffer.indexOf(F("+CDS:"));
-    int firstIndexHandle = 0;
-    int lastIndexHandle = 0;
-    //bool hasMeetFirstCrlf = false;
+    _polling = true;
+    _setRxReady(true);
 
-    if(indexOfCds != -1)
+    while (this->SoftwareSerial::available() > 0)
     {
-        // Here we receive a Status report
-        // Response format
-        //+CDS: 33\r\n
-        //07913366003000F006090B913356108867F8122091901000401220919010004000\r\n
+        char c = (char) read();
+
+        // Numeric result codes end with a bare <CR>
+        if (c == '\n' || c == '\r')
+        {
+#if SIM800L_ENABLE_USSD
+            // The text of +CUSD can span several lines
+            if (_urcLine.length() < USSD_LINE_MAX_LENGTH && _urcLine.startsWith(F("+CUSD:")) && _quoteOpen(_urcLine))
+            {
+                if (c == '\n') _urcLine += c;
+                continue;
+            }
+#endif
+            _urcLine.trim();
+            if (_urcLine.length() > 0)
+            {
+#if SIM800L_ENABLE_SMS
+                // Only here: checkForGsmMessage() and checkForSMS() take
+                // the +CMT and +CMTI of their own reads
+                if (_handleSmsUrc(_urcLine)) handled = true;
+                else if (_handleUrc(_urcLine)) handled = true;
+#else
+                if (_handleUrc(_urcLine)) handled = true;
+#endif
+                else _handleLine(_urcLine);
+            }
+            _urcLine = "";
+        }
+        else if (_urcLine.length() < URC_LINE_MAX_LENGTH
+#if SIM800L_ENABLE_USSD
+                 || (_urcLine.length() < USSD_LINE_MAX_LENGTH && _urcLine.startsWith(F("+CUSD:")))
+#endif
+#if SIM800L_ENABLE_SMS
+                 || ((_smsBodyPending || _statusReportPending || _urcLine.startsWith(F("+CDS:"))) && _urcLine.length() < SMS_LINE_MAX_LENGTH)
+#endif
+                )
+        {
+            _urcLine += c;
+        }
+    }
+
+    _setRxReady(false);
+    _checkOverflow();
+
+    if (_commandStatus == commandPending && millis() - _commandStart > _commandTimeout)
+    {
+        _commandStatus = commandTimeout;
+        _lastError = errorTimeout;
+        _lastErrorCode = 0;
+        _latencyTimeout(_commandType);
+    }
+    _runTasks();
+
+#if SIM800L_ENABLE_SMS
+    checkDeliveryTimeouts();
+#endif
+#if SIM800L_ENABLE_DTMF
+    if (_dtmfTimeout != 0 && _callState == callActive && millis() - _dtmfTime >= _dtmfTimeout)
+    {
+        _dtmfKey(DTMF_KEY_TIME_OUT);
+    }
+#endif
+
+    _polling = false;
+    return handled;
+}
+
+/*
+ * The *Async methods start a multi-step procedure that runs inside poll(),
+ * between the other events, and return false if it is already running.
+ * onTaskDone(id, success) is called at the end.
+ * A blocking method called while a task waits for an answer first runs
+ * poll() until that answer is in, see _waitTaskCommand().
+ */
+bool Sim800L::resetAsync()
+{
+    if (isTaskRunning(taskReset)) return false;
+    return _startTask(taskReset);
+}
+
+bool Sim800L::activateBearerProfileAsync()
+{
+    if (isTaskRunning(taskBearer)) return false;
+    return _startTask(taskBearer);
+}
+
+#if SIM800L_ENABLE_PIN
+bool Sim800L::disablePinAsync(String pin)
+{
+    if (isTaskRunning(taskDisablePin)) return false;
+    _taskText = pin;
+    return _startTask(taskDisablePin);
+}
+#endif
+
+#if SIM800L_ENABLE_RTC
+bool Sim800L::updateRtcAsync(int utc)
+{
+    if (isTaskRunning(taskUpdateRtc)) return false;
+    _taskUtc = utc;
+    return _startTask(taskUpdateRtc);
+}
+#endif
+
+bool Sim800L::isTaskRunning(TaskId id)
+{
+    return _tasks[id].running;
+}
+
+#if SIM800L_ENABLE_WATCHDOG
+/*
+ * Supervise the module from poll(), probing it every interval ms. 0 stops.
+ * onRecovery(hardReset, success) is called after each restart.
+ */
+bool Sim800L::setWatchdog(uint32_t interval)
+{
+    _watchdogInterval = interval;
+    if (interval == 0 || isTaskRunning(taskWatchdog)) return true;
+    return _startTask(taskWatchdog);
+}
+
+uint16_t Sim800L::getRecoveries()
+{
+    return _recoveries;
+}
+#endif
+
+/*
+ * Timeouts follow the latency observed for each type of command, as TCP does
+ * for its retransmission timer: smoothed latency + 4 * mean deviation, never
+ * below minTimeouts nor above the maximum of the datasheet. Until ADAPTIVE_MIN_SAMPLES answers are
+ * seen, or when disabled, the datasheet maximum is used.
+ */
+void Sim800L::setAdaptiveTimeouts(bool state)
+{
+    _adaptiveTimeouts = state;
+}
+
+uint32_t Sim800L::getCommandTimeout(CommandType type)
+{
+    uint32_t maximum = pgm_read_dword(&maxTimeouts[type]);
+
+    if (!_adaptiveTimeouts || _latencySamples[type] < ADAPTIVE_MIN_SAMPLES) return maximum;
+
+    uint32_t minimum = pgm_read_dword(&minTimeouts[type]);
+    uint32_t timeout = (uint32_t) _latency[type] + 4 * (uint32_t) _latencyDeviation[type] + ADAPTIVE_MARGIN;
+    if (timeout < minimum) timeout = minimum;
+    return timeout < maximum ? timeout : maximum;
+}
+
+#if SIM800L_ENABLE_RECORDER
+/*
+ * Every byte exchanged with the module is passed to recorder,
+ * NULL stops the recording.
+ */
+void Sim800L::setRecorder(Sim800LRecorder *recorder)
+{
+    if (_recorder != NULL) _recorder->flush();
+    _recorder = recorder;
+}
+#endif
+
+/*
+ * Every byte for the module goes through one of the two write(), never
+ * SoftwareSerial::write() directly, or it skips the CTS check.
+ */
+size_t Sim800L::write(uint8_t c)
+{
+    _waitTaskCommand();
+
+    if (_ctsPin != FLOW_CONTROL_NONE)
+    {
+        // CTS high: the module cannot take more data
+        uint32_t timeOld = millis();
+        while (digitalRead(_ctsPin) == HIGH && (millis() - timeOld < CTS_TIME_OUT)) _idle(timeOld);
+    }
+
+#if SIM800L_ENABLE_RECORDER
+    if (_recorder != NULL) _recorder->record(RECORDER_TX, c);
+#endif
+    return this->SoftwareSerial::write(c);
+}
+
+/*
+ * A whole command line: one flow control check and the bytes back to back
+ */
+size_t Sim800L::write(const uint8_t *buffer, size_t size)
+{
+    _waitTaskCommand();
+
+    if (_ctsPin != FLOW_CONTROL_NONE)
+    {
+        uint32_t timeOld = millis();
+        while (digitalRead(_ctsPin) == HIGH && (millis() - timeOld < CTS_TIME_OUT)) _idle(timeOld);
+    }
+
+    for (size_t i = 0; i < size; i++)
+    {
+#if SIM800L_ENABLE_RECORDER
+        if (_recorder != NULL) _recorder->record(RECORDER_TX, buffer[i]);
+#endif
+        this->SoftwareSerial::write(buffer[i]);
+    }
+    return size;
+}
+
+int Sim800L::read()
+{
+    int c = this->SoftwareSerial::read();
+#if SIM800L_ENABLE_RECORDER
+    if (c >= 0 && _recorder != NULL) _recorder->record(RECORDER_RX, c);
+#endif
+    return c;
+}
+
+/*
+ * AT+IFC=2,2	RTS/CTS hardware flow control in both directions
+ *
+ * rts: MCU output wired to the RTS input of the module, kept high (module
+ *      must hold its data) except while the library is reading, so nothing
+ *      is lost when loop() is busy.
+ * cts: MCU input wired to the CTS output of the module.
+ */
+bool Sim800L::setFlowControl(uint8_t rts, uint8_t cts)
+{
+    this->SoftwareSerial::print(F("AT+IFC=2,2\r"));
+    _buffer=_readSerial();
+    if(!_isOk(_buffer))
+    {
+        return false;
+    }
+
+    _rtsPin = rts;
+    _ctsPin = cts;
+    pinMode(_rtsPin, OUTPUT);
+    pinMode(_ctsPin, INPUT);
+    _setRxReady(false);
+    return true;
+}
+
+/*
+ * Put the MCU in idle sleep while the blocking methods wait for the module
+ * (AVR only, returns false elsewhere). The timers, the other interrupts and
+ * onIdle keep running.
+ */
+bool Sim800L::setIdleSleep(bool state)
+{
+#if defined(__AVR__)
+    _idleSleep = state;
+    return true;
+#else
+    _idleSleep = false;
+    return !state;
+#endif
+}
+
+/*
+ * Number of times the RX buffer overflowed and bytes were lost
+ */
+uint16_t Sim800L::getRxOverflowCount()
+{
+    return _rxOverflowCount;
+}
+
+/*
+ * True if bytes were lost during the last read
+ */
+bool Sim800L::lastReadOverflowed()
+{
+    return _lastReadOverflowed;
+}
+
+
+#if SIM800L_ENABLE_SMS
+int Sim800L::sendSms(String pdu)
+{
+    int pduLength = (pdu.length() / 2)-1;
+
+    if(pduLength < 10 || isBusy)
+    {
+        // Bad Pdu
+        return -4;
+    }
+
+    isBusy = true;
+    Sim800LCommand command(*this);
+    command.print (F("AT+CMGS="));  	// command to send sms
+    command.print (pduLength);
+    command.println();
+    command.send();
+    _buffer=_readSerial(100);
+    this->SoftwareSerial::print (pdu);
+    _buffer=_readSerial(100);
+    write(0x1a); // Ctrl+Z end of the message
+    _buffer=_readSerial(commandSmsSend);
+    
+    //expect CMGS:xxx   , where xxx is a number,for the sending sms.
+    if (_isError(_buffer)) {
+        isBusy = false;
+        return -2;
+    }
+    
+    if ((_buffer.indexOf(F("CMGS"))) < 0) {
+        isBusy = false;
+        return -3;
+  	}
+    
+    int indexOfTwoDots = _buffer.indexOf(':');
+
+    isBusy = false;
+
+    if(indexOfTwoDots == -1)
+    {
+        return -1;
+    }
+
+    int reference = (_buffer.substring(indexOfTwoDots+1)).toInt();
+    _trackSubmit(reference);
+    return reference;
+
+}
+
+bool Sim800L::sendSms(char* number,char* text)
+{
+
+    // Can take up to 60 seconds
+    if (isBusy) return true;
+    isBusy = true;
+
+    this->SoftwareSerial::print (F("AT+CMGF=1\r")); 	//set sms to text mode
+    _buffer=_readSerial();
+    Sim800LCommand command(*this);
+    command.print (F("AT+CMGS=\""));  	// command to send sms
+    command.print (number);
+    command.print(F("\"\r"));
+    command.send();
+    _buffer=_readSerial();
+    this->SoftwareSerial::print (text);
+    this->SoftwareSerial::print (F("\r"));
+    _buffer=_readSerial();
+    this->SoftwareSerial::print((char)26);
+    _buffer=_readSerial(commandSmsSend);
+    isBusy = false;
+    // Serial.println(_buffer);
+    //expect CMGS:xxx   , where xxx is a number,for the sending sms.
+    if (_isError(_buffer)) {
+        return true;
+    } else if ((_buffer.indexOf(F("CMGS"))) != -1) {
+        return false;
+  	} else {
+    	return true;
+  	}
+    // Error found, return 1
+    // Error NOT found, return 0
+}
+
+/*
+ * AT+CSCS="UCS2"	Number and text of AT+CMGS as hex UCS2
+ * AT+CSMP=17,167,0,8	DCS 8, the message is sent as UCS2
+ * The UTF-8 text goes to the module while it is converted, up to 70
+ * characters. Returns true when the message is sent.
+ */
+bool Sim800L::sendSmsUnicode(const char *number, const char *text)
+{
+    // Can take up to 60 seconds
+    if (isBusy) return false;
+
+    this->SoftwareSerial::print (F("AT+CMGF=1\r")); 	//set sms to text mode
+    _buffer=_readSerial();
+    this->SoftwareSerial::print (F("AT+CSCS=\"UCS2\";+CSMP=17,167,0,8\r"));
+    if (!_isOk(_readSerial()))
+    {
+        return false;
+    }
+
+    isBusy = true;
+
+    this->SoftwareSerial::print (F("AT+CMGS=\""));
+    _printUcs2(number);
+    this->SoftwareSerial::print(F("\"\r"));
+    _buffer=_readSerial();
+    _printUcs2(text);
+    this->SoftwareSerial::print((char)26);
+    _buffer=_readSerial(commandSmsSend);
+    bool sent = _buffer.indexOf(F("+CMGS")) != -1 && !_isError(_buffer);
+    isBusy = false;
+    ModemError error = _lastError;
+    uint16_t code = _lastErrorCode;
+
+    // back to GSM characters for the other text mode commands
+    this->SoftwareSerial::print (F("AT+CSCS=\"GSM\";+CSMP=17,167,0,0\r"));
+    _readSerial();
+
+    _lastError = error;
+    _lastErrorCode = code;
+    return sent;
+}
+
+/*
+ * AT+CMGW	Write the message once to the storage, +CMGW: <index>
+ * AT+CMMS=1	Keep the link open between the messages
+ * AT+CMSS=<index>,"<number>"	Send it from the storage, +CMSS: <mr>
+ * onBroadcastResult(index, reference) is called for each number, with the
+ * message reference or -1 (see getLastError()). Returns the messages sent.
+ */
+uint8_t Sim800L::broadcastSms(const char *const *numbers, uint8_t count, const char *text)
+{
+    if (isBusy) return 0;
+
+    this->SoftwareSerial::print (F("AT+CMGF=1\r")); 	//set sms to text mode
+    _buffer=_readSerial();
+
+    this->SoftwareSerial::print (F("AT+CMGW\r"));
+    _buffer=_readSerial();
+    this->SoftwareSerial::print (text);
+    this->SoftwareSerial::print((char)26);
+    _buffer=_readSerial(commandSmsSend);
+    int header = _buffer.indexOf(F("+CMGW:"));
+    if (header == -1)
+    {
+        return 0;
+    }
+    uint8_t stored = _buffer.substring(header + 6).toInt();
+    _smsUsed++;
+
+    isBusy = true;
+
+    // Refused, each message opens its own link: slower, but still sent
+    this->SoftwareSerial::print (F("AT+CMMS=1\r"));
+    bool linkKept = _isOk(_readSerial());
+
+    uint8_t sent = 0;
+    for (uint8_t i = 0; i < count; i++)
+    {
+        // Can take up to 60 seconds
+        Sim800LCommand command(*this);
+        command.print (F("AT+CMSS="));
+        command.print (stored);
+        command.print (F(",\""));
+        command.print (numbers[i]);
+        command.print (F("\"\r"));
+        command.send();
+        _buffer=_readSerial(commandSmsSend);
+
+        int reference = -1;
+        header = _buffer.indexOf(F("+CMSS:"));
+        if (header != -1 && !_isError(_buffer))
+        {
+            reference = _buffer.substring(header + 6).toInt();
+            sent++;
+        }
+        if (onBroadcastResult != NULL) onBroadcastResult(i, reference);
+    }
+
+    if (linkKept)
+    {
+        // Its answer does not matter: after a few idle seconds the module
+        // closes the link and goes back to AT+CMMS=0 by itself
+        this->SoftwareSerial::print (F("AT+CMMS=0\r"));
+        _readSerial();
+    }
+    isBusy = false;
+    delSms(stored);
+
+    return sent;
+}
+
+bool Sim800L::setPduMode()
+{
+	this->SoftwareSerial::print(F("AT+CMGF=0\r"));
+    _buffer=_readSerial();
+    
+    if(!_isOk(_buffer))
+    {
+        return false;
+    }
+
+    _savedSmsMode = 0;
+    return true;
+}
+
+bool Sim800L::setTextMode()
+{
+	this->SoftwareSerial::print(F("AT+CMGF=1\r"));
+    _buffer=_readSerial();
+    Serial.print(_buffer);
+    if(!_isOk(_buffer))
+    {
+        return false;
+    }
+
+    _savedSmsMode = 1;
+    return true;
+}
+
+bool Sim800L::prepareForSmsReceive()
+{
+	return setSmsDelivery(smsDeliverDirect); // 2,1,0,1,0 Active Ds mode (Data report)
+}
+
+/*
+ * AT+CNMI=2,<mt>,0,1,0	Route the new messages:
+ * smsDeliverDirect	+CMT: <header> and the message on the next line, not stored
+ * smsDeliverStore	+CMTI: "SM",<index>, the message stays on the SIM
+ * smsDeliverNone	stored, not reported
+ * The status reports come with +CDS in every profile. poll() passes +CMT to
+ * onSms (or onNewMessage), +CMTI to onSmsStored and +CDS to onStatusReport
+ * and the delivery tracking.
+ */
+bool Sim800L::setSmsDelivery(SmsDelivery delivery)
+{
+    Sim800LCommand command(*this);
+    command.print(F("AT+CNMI=2,"));
+    command.print((uint8_t) delivery);
+    command.print(F(",0,1,0\r"));
+    command.send();
+
+    _buffer=_readSerial();
+    if(!_isOk(_buffer))
+    {
+        return false;
+    }
+
+    // The whole message is assembled by poll(), without reallocations
+    if (delivery == smsDeliverDirect) _urcLine.reserve(SMS_LINE_MAX_LENGTH);
+    _smsDelivery = delivery;
+    return true;
+}
+
+void Sim800L::checkForGsmMessage()
+{
+	 _smsUrcsParsed = true;	// +CDS and +CMT are parsed here, not by _dispatchUrcs()
+	 _buffer = _readSerial(100);
+	 if(_buffer.length() == 0)
+	 {
+        _smsUrcsParsed = false;
+        return ;
+	 	//return 0;
+	 }
+     _buffer += _readSerial(5000);
+     _smsUrcsParsed = false;
+   /*  Serial.println("checkForSMS");
+
+	 Serial.println(_buffer);
+     
+	 Serial.println("-----------------");*/
+
+    int indexOfCds = _buffer.indexOf(F("+CDS:"));
+    int firstIndexHandle = 0;
+    int lastIndexHandle = 0;
+    //bool hasMeetFirstCrlf = false;
+
+    if(indexOfCds != -1)
+    {
+        // Here we receive a Status report
+        // Response format
+        //+CDS: 33\r\n
+        //07913366003000F006090B913356108867F8122091901000401220919010004000\r\n
 
         for(int i = indexOfCds; i < _buffer.length(); i++)
         {
-           /* if(hasMeetFirstCrlf)
+           /* if(hasMeetFirstCrlf)
+            {
+            // need to wait for the first CR
+            Serial.print(_buffer[i]);
+            Serial.print(" --- ");
+            Serial.println(_buffer[i], HEX);
+            }*/
+         
+            if(i>0 && _buffer[i-1] == '\r' && _buffer[i] == '\n')
+            {
+                if(firstIndexHandle == 0)
+                {
+                    firstIndexHandle = i+1;
+
+                    //hasMeetFirstCrlf = true;
+                }
+                else{
+                    lastIndexHandle = i-1;
+                    // we are at the end of the line. Need to send info
+                    if(firstIndexHandle > 0 && lastIndexHandle > firstIndexHandle)
+                    {
+                        String report = _buffer.substring(firstIndexHandle, lastIndexHandle);
+                        if(onStatusReport != NULL){
+                            onStatusReport(report);
+                        }
+                        _trackStatusReport(report);
+                    }
+                }
+              
+            }
+        }
+
+    }
+
+    firstIndexHandle = 0;
+    lastIndexHandle = 0;
+    int indexOfCMT = _buffer.indexOf(F("+CMT:"));
+
+    while(indexOfCMT != -1){
+    // Here we receive a new message
+    // Response format
+    //+CMT: "",135\r\n
+    //07913366003000F0240B913356108867F800001220919013734084C170381C0E87C3E170381C0E87C3E170381C0E87C3E1B05EAFD7EBF57ABD7E3E9FCFCF67341AAD56ABD56A75BD9E4AD3631ADA9FBEBC97AE3DE84974EFDE8436DFAD3872C68C62152C68C92399C29396BD964A31634AA56BD6A59CD6\r\n
+
+        for(int i = indexOfCMT; i < _buffer.length(); i++)
+        {
+           
+            // need to wait for the first CR
+           /* Serial.print(_buffer[i]);
+            Serial.print(" --- ");
+            Serial.println(_buffer[i], HEX);*/
+            
+         
+            if(i>0 && (_buffer[i-1] == '\r' && _buffer[i] == '\n') || (_buffer[i] == '\n'))
+            {
+                if(firstIndexHandle == 0)
+                {
+                    firstIndexHandle = i+1;
+
+                    //hasMeetFirstCrlf = true;
+                }
+                else{
+
+                    if(_buffer[i-1] == '\r')
+                    {lastIndexHandle = i-1;}
+                    else
+                    {lastIndexHandle = i;}
+                    // we are at the end of the line. Need to send info
+                    if(firstIndexHandle > 0 && lastIndexHandle > firstIndexHandle)
+                    {
+                        if(onSms != NULL){
+                             _parseSmsHeader(_buffer, indexOfCMT);
+                             onSms(_smsHeader, _buffer.c_str() + firstIndexHandle, lastIndexHandle - firstIndexHandle);
+                        }
+                        else if(onNewMessage != NULL){
+                             onNewMessage(_buffer.substring(firstIndexHandle, lastIndexHandle));
+                        }
+
+                        // Check all messages in the _buffer. Indeed, we can have more than one message
+                        indexOfCMT = _buffer.indexOf(F("+CMT:"), lastIndexHandle); // add the header '+CMT:' length
+                        firstIndexHandle = 0;
+                        
+                    }
+                }
+              
+            }
+        }
+    }
+    
+    //return _buffer;
+	 // +CMTI: "SM",1
+	// if(_buffer.indexOf("+CMTI:") == -1)
+	// {
+	// 	return 0;
+	// }
+	// return _buffer.substring(_buffer.indexOf(',')+1).toInt();
+}
+
+const uint8_t Sim800L::checkForSMS()
+{
+	 _smsUrcsParsed = true;	// +CMTI is parsed here, not by _dispatchUrcs()
+	 _buffer = _readSerial(100);
+	 if(_buffer.length() == 0)
+	 {
+	 	_smsUrcsParsed = false;
+	 	return 0;
+	 }
+     _buffer += _readSerial(1000);
+     _smsUrcsParsed = false;
+     
+	 // +CMTI: "SM",1
+	 int indexOfCmti = _buffer.indexOf(F("+CMTI:"));
+	 if(indexOfCmti == -1)
+	 {
+	 	return 0;
+	 }
+	 uint8_t index = _buffer.substring(_buffer.indexOf(',', indexOfCmti)+1).toInt();
+
+	 // Keep room for the next messages, unread ones are never deleted
+	 _smsUsed++;
+	 if (_smsAutoCleanup && isSmsStorageFull())
+	 {
+	 	delSmsByStatus(smsDeleteReadAndSent);
+	 	getSmsStorage(NULL, NULL);
+	 }
+	 return index;
+}
+
+
+String Sim800L::getNumberSms(uint8_t index)
+{
+    _buffer=readSms(index);
+    //Serial.println(_buffer.length());
+    if (_buffer.length() > 10) //avoid empty sms
+    {
+        uint8_t _idx1=_buffer.indexOf(F("+CMGR:"));
+        _idx1=_buffer.indexOf("\",\"",_idx1+1);
+        return _buffer.substring(_idx1+3,_buffer.indexOf("\",\"",_idx1+4));
+    }
+    else
+    {
+        return "";
+    }
+}
+
+String Sim800L::readSms(uint8_t index)
+{
+    // Can take up to 5 seconds
+
+    if ( _isError(_readSerial(5000)))
+    {
+    	return "";
+    }
+
+    Sim800LCommand command(*this);
+    command.print (F("AT+CMGR="));
+    command.print (index);
+    command.print ("\r");
+    command.send();
+    _buffer=_readSerial();
+   //Serial.println("Received !!");
+   //Serial.println(_buffer);
+    // Without echo there is nothing to check before the answer
+    if (!_compactMode && _buffer.indexOf(F("CMGR=")) == -1)
+    {
+    	return "";
+    }
+
+    //Serial.println(_buffer);
+    // The answer may already have been read together with the echo
+    if (_buffer.indexOf(F("+CMGR:")) == -1)
+    {
+        _buffer = _readSerial(10000);
+    }
+    int header = _buffer.indexOf(F("+CMGR:"));
+    if (header == -1)
+    {
+        return "";
+    }
+	int first = _buffer.indexOf('\n', header) + 1;
+	int second = _buffer.indexOf('\n', first);
+    String message = _buffer.substring(first, second);
+
+    if (_deleteAfterRead)
+    {
+        delSms(index);
+    }
+    return message;
+}
+
+
+bool Sim800L::delAllSms()
+{
+    // Can take up to 25 seconds
+
+    this->SoftwareSerial::print(F("AT+CMGD=4\r"));
+    _buffer=_readSerial(commandSmsDelete);
+    
+    if ( !_isError(_buffer))
+    {
+        return false;
+    }
+    else return true;
+    // Error found, return 1
+    // Error NOT found, return 0
+}
+
+
+bool Sim800L::delSms(uint8_t index)
+{
+    Sim800LCommand command(*this);
+    command.print(F("AT+CMGD="));
+    command.print(index);
+    command.print(F("\r"));
+    command.send();
+    _buffer=_readSerial();
+
+    if (!_isOk(_buffer))
+    {
+        return false;
+    }
+    if (_smsUsed > 0) _smsUsed--;
+    return true;
+}
+
+/*
+ * AT+CMGD=1,1	Delete all read messages
+ * AT+CMGD=1,2	Delete all read and sent messages
+ * AT+CMGD=1,3	Delete all read, sent and unsent messages
+ * Unread messages are kept, use delAllSms() to delete them too.
+ */
+bool Sim800L::delSmsByStatus(SmsDeleteFlag flag)
+{
+    // Can take up to 25 seconds
+
+    Sim800LCommand command(*this);
+    command.print(F("AT+CMGD=1,"));
+    command.print((uint8_t) flag);
+    command.print(F("\r"));
+    command.send();
+    _buffer=_readSerial(commandSmsDelete);
+
+    if (!_isOk(_buffer))
+    {
+        return false;
+    }
+    return true;
+}
+
+/*
+ * +CPMS: "SM",3,30,"SM",3,30,"SM",3,30
+ * used and total refer to the storage where messages are read and deleted,
+ * both can be NULL to only refresh isSmsStorageFull().
+ */
+bool Sim800L::getSmsStorage(uint16_t *used, uint16_t *total)
+{
+    this->SoftwareSerial::print(F("AT+CPMS?\r"));
+    _buffer=_readSerial();
+
+    int indexOfCpms = _buffer.indexOf(F("+CPMS:"));
+    if (indexOfCpms == -1)
+    {
+        return false;
+    }
+
+    int first = _buffer.indexOf(',', indexOfCpms) + 1;
+    int second = _buffer.indexOf(',', first) + 1;
+    _smsUsed = _buffer.substring(first, second - 1).toInt();
+    _smsTotal = _buffer.substring(second).toInt();
+
+    if (used != NULL) *used = _smsUsed;
+    if (total != NULL) *total = _smsTotal;
+    return true;
+}
+
+/*
+ * storage: "SM" (SIM, default) or "ME" (module, more slots).
+ * Used for reading, writing and receiving messages.
+ */
+bool Sim800L::setSmsStorage(String storage)
+{
+    String command;
+    command  = "AT+CPMS=\"" + storage + "\",\"" + storage + "\",\"" + storage + "\"";
+    command += "\r";
+
+    this->SoftwareSerial::print(command);
+    _buffer=_readSerial();
+
+    if (!_isOk(_buffer))
+    {
+        return false;
+    }
+    return getSmsStorage(NULL, NULL);
+}
+
+bool Sim800L::isSmsStorageFull()
+{
+    return _smsTotal > 0 && _smsUsed >= _smsTotal;
+}
+
+/*
+ * Delete every message once readSms() returned it
+ */
+void Sim800L::setDeleteAfterRead(bool state)
+{
+    _deleteAfterRead = state;
+}
+
+/*
+ * When checkForSMS() finds the storage full, delete the read and sent
+ * messages so new ones can still be received.
+ * Needs getSmsStorage() to be called once to know the capacity.
+ */
+void Sim800L::setSmsAutoCleanup(bool state)
+{
+    _smsAutoCleanup = state;
+}
+
+/*
+ * Messages sent with sendSms(pdu) are kept in a table of DELIVERY_TABLE_SIZE
+ * entries until their status report arrives through checkForGsmMessage()
+ * or timeout ms elapse. onDeliveryReport is called in both cases.
+ * The pdu must request a status report (TP-SRR) and AT+CNMI must route
+ * them (prepareForSmsReceive).
+ */
+void Sim800L::setDeliveryTimeout(uint32_t timeout)
+{
+    _deliveryTimeout = timeout;
+}
+
+uint8_t Sim800L::getPendingDeliveries()
+{
+    uint8_t pending = 0;
+    for (uint8_t i = 0; i < DELIVERY_TABLE_SIZE; i++)
+    {
+        if (_deliveries[i].reference != DELIVERY_FREE) pending++;
+    }
+    return pending;
+}
+
+/*
+ * Report as timed out the messages waiting for longer than the delivery
+ * timeout. Called by poll().
+ */
+void Sim800L::checkDeliveryTimeouts()
+{
+    uint32_t now = millis();
+
+    for (uint8_t i = 0; i < DELIVERY_TABLE_SIZE; i++)
+    {
+        if (_deliveries[i].reference == DELIVERY_FREE) continue;
+        if (now - _deliveries[i].submitted < _deliveryTimeout) continue;
+
+        _reportDelivery(i, DELIVERY_STATUS_TIME_OUT, NULL);
+    }
+}
+#endif
+
+#if SIM800L_ENABLE_RTC
+void Sim800L::RTCtime(int *day,int *month, int *year,int *hour,int *minute, int *second)
+{
+    this->SoftwareSerial::print(F("at+cclk?\r\n"));
+    // if respond with ERROR try one more time.
+    _buffer=_readSerial();
+    if (_isError(_buffer))
+    {
+        _delay(50);
+        this->SoftwareSerial::print(F("at+cclk?\r\n"));
+    }
+    if (!_isError(_buffer))
+    {
+        _buffer=_buffer.substring(_buffer.indexOf("\"")+1,_buffer.lastIndexOf("\"")-1);
+        *year=_buffer.substring(0,2).toInt();
+        *month= _buffer.substring(3,5).toInt();
+        *day=_buffer.substring(6,8).toInt();
+        *hour=_buffer.substring(9,11).toInt();
+        *minute=_buffer.substring(12,14).toInt();
+        *second=_buffer.substring(15,17).toInt();
+    }
+}
+
+//Get the time  of the base of GSM
+String Sim800L::dateNet()
+{
+    this->SoftwareSerial::print(F("AT+CIPGSMLOC=2,1\r\n "));
+    _buffer=_readSerial();
+
+    if (_isOk(_buffer) )
+    {
+        int start = _buffer.indexOf(":")+2;
+        return _buffer.substring(start, _buffer.indexOf('\r', start));
+    }
+    else
+        return "0";
+}
+
+// Update the RTC of the module with the date of GSM.
+bool Sim800L::updateRtc(int utc)
+{
+
+    activateBearerProfile();
+    _buffer=dateNet();
+    deactivateBearerProfile();
+
+    this->SoftwareSerial::print(_rtcCommand(_buffer, utc));
+    if ( _isError(_readSerial()))
+    {
+        return true;
+    }
+    else return false;
+
+
+}
+/*
+ * Build the AT+CCLK command setting the module clock from the
+ * date returned by AT+CIPGSMLOC=2,1 ("0,2021/02/19,09:01:00")
+ */
+String Sim800L::_rtcCommand(String date, int utc)
+{
+    date=date.substring(date.indexOf(",")+1,date.length());
+    String dt=date.substring(0,date.indexOf(","));
+    String tm=date.substring(date.indexOf(",")+1,date.length()) ;
+
+    int hour = tm.substring(0,2).toInt();
+    int day = dt.substring(8,10).toInt();
+
+    hour=hour+utc;
+
+    String tmp_hour;
+    String tmp_day;
+    //TODO : fix if the day is 0, this occur when day is 1 then decrement to 1,
+    //       will need to check the last month what is the last day .
+    if (hour<0)
+    {
+        hour+=24;
+        day-=1;
+    }
+    if (hour<10)
+    {
+
+        tmp_hour="0"+String(hour);
+    }
+    else
+    {
+        tmp_hour=String(hour);
+    }
+    if (day<10)
+    {
+        tmp_day="0"+String(day);
+    }
+    else
+    {
+        tmp_day=String(day);
+    }
+    //for debugging
+    //Serial.println("at+cclk=\""+dt.substring(2,4)+"/"+dt.substring(5,7)+"/"+tmp_day+","+tmp_hour+":"+tm.substring(3,5)+":"+tm.substring(6,8)+"-03\"\r\n");
+    return "at+cclk=\""+dt.substring(2,4)+"/"+dt.substring(5,7)+"/"+tmp_day+","+tmp_hour+":"+tm.substring(3,5)+":"+tm.substring(6,8)+"-03\"\r\n";
+}
+
+#endif
+
+//
+//PRIVATE METHODS
+//
+void Sim800L::_updateLatency(CommandType type, uint32_t sample)
+{
+    if (sample > 0xFFFF) sample = 0xFFFF;
+
+    if (_latencySamples[type] == 0)
+    {
+        _latency[type] = sample;
+        _latencyDeviation[type] = sample / 2;
+    }
+    else
+    {
+        // gains 1/8 and 1/4 (RFC 6298)
+        int32_t error = (int32_t) sample - _latency[type];
+        _latency[type] += error / 8;
+        _latencyDeviation[type] += ((error < 0 ? -error : error) - (int32_t) _latencyDeviation[type]) / 4;
+    }
+
+    if (_latencySamples[type] < 255) _latencySamples[type]++;
+    _timeOuts = 0;
+}
+
+/*
+ * A healthy module may just be slower than learned: widen the next timeout
+ */
+void Sim800L::_latencyTimeout(CommandType type)
+{
+    uint32_t deviation = (uint32_t) _latencyDeviation[type] * 2 + ADAPTIVE_MARGIN;
+    _latencyDeviation[type] = deviation > 0xFFFF ? 0xFFFF : deviation;
+    if (_timeOuts < 255) _timeOuts++;
+}
+
+/*
+ * Lines that are not events belong to the command sent by a task
+ */
+void Sim800L::_handleLine(const String &line)
+{
+    if (_commandStatus != commandPending) return;
+
+    if (line == F("OK") || (_compactMode && line == F("0")))
+    {
+        _commandStatus = commandOk;
+        _lastError = errorNone;
+        _lastErrorCode = 0;
+        _updateLatency(_commandType, millis() - _commandStart);
+        return;
+    }
+    if (line == F("ERROR") || (_compactMode && line == F("4")) || line.startsWith(F("+CME ERROR")) || line.startsWith(F("+CMS ERROR")))
+    {
+        _commandStatus = commandError;
+        _setLastError(line + '\r');
+        // No sample: a quick refusal says nothing of the time to execute
+        return;
+    }
+
+    _commandResponse += line;
+    _commandResponse += '\n';
+}
+
+/*
+ * Wait condition of a task sending a command: the first call sends it as
+ * soon as no other task owns the line, it returns true when the final result
+ * is in _commandStatus and the answer in _commandResponse.
+ */
+bool Sim800L::_taskCommand(Sim800LTask &task, const __FlashStringHelper *command, CommandType type)
+{
+    if (_commandOwner == NULL)
+    {
+        _commandOwner = &task;
+        _commandResponse = "";
+        // Sent before it is pending, write() waits while a command is pending
+        this->SoftwareSerial::print(command);
+        _commandStatus = commandPending;
+        _commandStart = millis();
+        _commandType = type;
+        _commandTimeout = getCommandTimeout(type);
+        return false;
+    }
+
+    if (_commandOwner != &task || _commandStatus == commandPending) return false;
+
+    _commandOwner = NULL;
+    return true;
+}
+
+bool Sim800L::_taskCommand(Sim800LTask &task, const String &command, CommandType type)
+{
+    if (_commandOwner == NULL)
+    {
+        _commandOwner = &task;
+        _commandResponse = "";
+        // Sent before it is pending, write() waits while a command is pending
+        this->SoftwareSerial::print(command);
+        _commandStatus = commandPending;
+        _commandStart = millis();
+        _commandType = type;
+        _commandTimeout = getCommandTimeout(type);
+        return false;
+    }
+
+    if (_commandOwner != &task || _commandStatus == commandPending) return false;
+
+    _commandOwner = NULL;
+    return true;
+}
+
+/*
+ * A blocking method must not take the answer of a command sent by a task:
+ * its first byte waits for that answer, running poll() so the tasks go on.
+ * It also waits for the end of a watchdog recovery: the module is restarting
+ * and gets its configuration back. The commands sent from poll() itself, by
+ * the tasks or by a callback, do not wait.
+ */
+void Sim800L::_waitTaskCommand()
+{
+    if (_polling) return;
+
+    uint32_t start = millis();
+#if SIM800L_ENABLE_WATCHDOG
+    while (_commandStatus == commandPending || _recovering)
+#else
+    while (_commandStatus == commandPending)
+#endif
+    {
+        poll();
+        _idle(start);
+    }
+}
+
+bool Sim800L::_startTask(TaskId id)
+{
+    if (_tasks[id].running) return false;
+
+    _tasks[id].line = 0;
+    _tasks[id].retries = 0;
+    _tasks[id].success = false;
+    _tasks[id].running = true;
+    return true;
+}
+
+void Sim800L::_runTasks()
+{
+    for (uint8_t i = 0; i < taskCount; i++)
+    {
+        if (!_tasks[i].running || !_runTask((TaskId) i)) continue;
+
+        _tasks[i].running = false;
+        if (onTaskDone != NULL) onTaskDone((TaskId) i, _tasks[i].success);
+    }
+}
+
+bool Sim800L::_runTask(TaskId id)
+{
+    switch (id)
+    {
+    case taskReset:
+        return _resetTask(_tasks[id]);
+    case taskBearer:
+        return _bearerTask(_tasks[id]);
+#if SIM800L_ENABLE_PIN
+    case taskDisablePin:
+        return _disablePinTask(_tasks[id]);
+#endif
+#if SIM800L_ENABLE_RTC
+    case taskUpdateRtc:
+        return _updateRtcTask(_tasks[id]);
+#endif
+#if SIM800L_ENABLE_CELL
+    case taskCellMonitor:
+        return _cellTask(_tasks[id]);
+#endif
+#if SIM800L_ENABLE_WATCHDOG
+    case taskWatchdog:
+        return _watchdogTask(_tasks[id]);
+#endif
+#if SIM800L_ENABLE_SIGNAL_LOG
+    case taskSignalLog:
+        return _signalLogTask(_tasks[id]);
+#endif
+#if SIM800L_ENABLE_USSD
+    case taskUssd:
+        return _ussdTask(_tasks[id]);
+#endif
+    default:
+        return true;
+    }
+}
+
+// Same steps as reset(), with a limit on the AT probes
+bool Sim800L::_resetTask(Sim800LTask &task)
+{
+    TASK_BEGIN(task);
+
+    if (LED_FLAG) digitalWrite(LED_PIN,1);
+    _smsReady = false;
+    _compactMode = false;
+
+    digitalWrite(RESET_PIN,1);
+    TASK_DELAY(task, 1000);
+    digitalWrite(RESET_PIN,0);
+    TASK_DELAY(task, 1000);
+
+    // wait for the module response
+    for (task.retries = 0; task.retries < RESET_RETRIES; task.retries++)
+    {
+        TASK_WAIT_UNTIL(task, _taskCommand(task, F("AT\r\n"), commandGeneric));
+        if (_commandStatus == commandOk) break;
+    }
+    if (task.retries == RESET_RETRIES)
+    {
+        if (LED_FLAG) digitalWrite(LED_PIN,0);
+        TASK_EXIT(task, false);
+    }
+
+    //wait for sms ready
+    task.timer = millis();
+    TASK_WAIT_UNTIL(task, _smsReady || millis() - task.timer > BOOT_TIME_OUT);
+
+    if (_smsReady) TASK_WAIT_UNTIL(task, _taskCommand(task, F("AT+CMEE=1\r"), commandGeneric));
+
+    if (LED_FLAG) digitalWrite(LED_PIN,0);
+    task.success = _smsReady;
+
+    TASK_END(task);
+}
+
+// Same steps as activateBearerProfile(), without the fixed delays
+bool Sim800L::_bearerTask(Sim800LTask &task)
+{
+    TASK_BEGIN(task);
+
+    TASK_WAIT_UNTIL(task, _taskCommand(task, F("AT+SAPBR=3,1,\"CONTYPE\",\"GPRS\"\r\n"), commandGeneric));
+    TASK_WAIT_UNTIL(task, _taskCommand(task, F("AT+SAPBR=3,1,\"APN\",\"internet\"\r\n"), commandGeneric));
+
+    // Can take up to 85 seconds
+    TASK_WAIT_UNTIL(task, _taskCommand(task, F("AT+SAPBR=1,1\r\n"), commandBearer));
+    TASK_WAIT_UNTIL(task, _taskCommand(task, F("AT+SAPBR=2,1\r\n"), commandGeneric));
+
+    // +SAPBR: 1,1,"10.0.0.1", status 1 is connected
+    task.success = _commandResponse.indexOf(F("+SAPBR: 1,1")) != -1;
+    // The watchdog opens it again after a recovery
+    if (task.success) _bearerActive = true;
+
+    TASK_END(task);
+}
+
+#if SIM800L_ENABLE_PIN
+bool Sim800L::_disablePinTask(Sim800LTask &task)
+{
+    TASK_BEGIN(task);
+
+    // Can take up to 5 seconds
+    TASK_WAIT_UNTIL(task, _taskCommand(task, "AT+CPIN=" + _taskText + "\r", commandPin));
+    if (_commandStatus != commandOk) TASK_EXIT(task, false);
+    _savedPin = _taskText;
+
+    TASK_WAIT_UNTIL(task, _taskCommand(task, "AT+CLCK=\"SC\",0,\"" + _taskText + "\"\r", commandPin));
+    task.success = _commandStatus == commandOk;
+
+    TASK_END(task);
+}
+#endif
+
+#if SIM800L_ENABLE_CELL
+// AT+CENG? every _cellInterval ms until setCellMonitoring(0)
+bool Sim800L::_cellTask(Sim800LTask &task)
+{
+    TASK_BEGIN(task);
+
+    TASK_WAIT_UNTIL(task, _taskCommand(task, F("AT+CENG=1,1\r"), commandGeneric));
+    if (_commandStatus != commandOk) TASK_EXIT(task, false);
+
+    while (_cellInterval != 0)
+    {
+        TASK_WAIT_UNTIL(task, _taskCommand(task, F("AT+CENG?\r"), commandGeneric));
+        if (_commandStatus == commandOk) _parseCellInfo(_commandResponse);
+
+        task.timer = millis();
+        TASK_WAIT_UNTIL(task, _cellInterval == 0 || millis() - task.timer >= _cellInterval);
+    }
+
+    TASK_WAIT_UNTIL(task, _taskCommand(task, F("AT+CENG=0\r"), commandGeneric));
+    task.success = true;
+
+    TASK_END(task);
+}
+#endif
+
+#if SIM800L_ENABLE_SIGNAL_LOG
+// AT+CSQ and AT+CREG? every _signalLogInterval ms until setSignalLog(NULL, 0)
+bool Sim800L::_signalLogTask(Sim800LTask &task)
+{
+    TASK_BEGIN(task);
+
+    while (_signalLogInterval != 0)
+    {
+        _signalRssi = SIGNAL_LOG_UNKNOWN;
+        _signalBer = SIGNAL_LOG_UNKNOWN;
+        TASK_WAIT_UNTIL(task, _taskCommand(task, F("AT+CSQ\r"), commandGeneric));
+        {
+            // +CSQ: <rssi>,<ber>
+            int start = _commandResponse.indexOf(F("+CSQ:"));
+            if (_commandStatus == commandOk && start != -1)
+            {
+                _signalRssi = cellField(_commandResponse, start + 5, 0, 10);
+                _signalBer = cellField(_commandResponse, start + 5, 1, 10);
+            }
+        }
+
+        TASK_WAIT_UNTIL(task, _taskCommand(task, F("AT+CREG?\r"), commandGeneric));
+        {
+            // +CREG: <n>,<stat>
+            uint8_t registration = NetworkRegistrationStatus::unknown;
+            int start = _commandResponse.indexOf(F("+CREG:"));
+            if (_commandStatus == commandOk && start != -1) registration = cellField(_commandResponse, start, 1, 10);
+
+            if (_signalLog != NULL) _signalLog->add(_signalRssi, _signalBer, registration);
+        }
+
+        task.timer = millis();
+        TASK_WAIT_UNTIL(task, _signalLogInterval == 0 || millis() - task.timer >= _signalLogInterval);
+    }
+    task.success = true;
+
+    TASK_END(task);
+}
+#endif
+
+#if SIM800L_ENABLE_USSD
+/*
+ * Send _ussdText and wait USSD_TIME_OUT ms for the +CUSD answer, handled by
+ * _handleUssd. On cancelUssd(), or without an answer, end the session.
+ */
+bool Sim800L::_ussdTask(Sim800LTask &task)
+{
+    TASK_BEGIN(task);
+
+    if (!_ussdCancel)
+    {
+        _ussdStatus = ussdPending;
+        TASK_WAIT_UNTIL(task, _taskCommand(task, "AT+CUSD=1,\"" + _ussdText + "\"\r", commandGeneric));
+        if (_commandStatus != commandOk)
+        {
+            _ussdEnd(ussdError);
+            TASK_EXIT(task, false);
+        }
+
+        task.timer = millis();
+        TASK_WAIT_UNTIL(task, _ussdStatus != ussdPending || _ussdCancel || millis() - task.timer >= USSD_TIME_OUT);
+        if (_ussdStatus != ussdPending) TASK_EXIT(task, _ussdStatus <= ussdReplyNeeded);
+        if (!_ussdCancel) _ussdEnd(ussdTimeout);
+    }
+
+    if (_ussdStatus == ussdPending || _ussdStatus == ussdReplyNeeded) _ussdStatus = ussdTerminated;
+    _ussdCancel = false;
+    TASK_WAIT_UNTIL(task, _taskCommand(task, F("AT+CUSD=2\r"), commandGeneric));
+    task.success = _ussdStatus != ussdTimeout && _commandStatus == commandOk;
+
+    TASK_END(task);
+}
+#endif
+
+#if SIM800L_ENABLE_WATCHDOG
+/*
+ * Probe the module every _watchdogInterval ms, and at once after a command
+ * timed out. After WATCHDOG_TIME_OUTS consecutive time outs, or a power down
+ * report, restart it with AT+CFUN=1,1, then with RESET_PIN if it stays
+ * silent, and send again the configuration it lost.
+ */
+bool Sim800L::_watchdogTask(Sim800LTask &task)
+{
+    TASK_BEGIN(task);
+
+    while (_watchdogInterval != 0)
+    {
+        task.timer = millis();
+        TASK_WAIT_UNTIL(task, _watchdogInterval == 0 || _powerDown || _timeOuts > 0 || millis() - task.timer >= _watchdogInterval);
+        if (_watchdogInterval == 0) break;
+
+        if (!_powerDown && _timeOuts < WATCHDOG_TIME_OUTS)
+        {
+            TASK_WAIT_UNTIL(task, _taskCommand(task, F("AT\r"), commandGeneric));
+            if (_commandStatus != commandTimeout || _timeOuts < WATCHDOG_TIME_OUTS) continue;
+        }
+
+        // Soft restart first, a powered down module needs the reset pin
+        _recovering = true;
+        task.success = false;
+        _smsReady = false;
+        if (!_powerDown)
+        {
+            TASK_WAIT_UNTIL(task, _taskCommand(task, F("AT+CFUN=1,1\r"), commandGeneric));
+            task.timer = millis();
+            TASK_WAIT_UNTIL(task, _smsReady || millis() - task.timer > BOOT_TIME_OUT);
+            task.success = _smsReady;
+        }
+        // retries counts the hardware resets of this recovery
+        task.retries = !task.success;
+        if (task.retries) TASK_SPAWN(task, _recoveryTask, _resetTask(_recoveryTask));
+        if (task.retries) task.success = _recoveryTask.success;
+
+        _powerDown = false;
+        _timeOuts = 0;
+        _compactMode = false;
+        _recoveries++;
+        if (!task.success)
+        {
+            _recovering = false;
+            if (onRecovery != NULL) onRecovery(task.retries, false);
+            continue;
+        }
+
+        TASK_WAIT_UNTIL(task, _taskCommand(task, F("AT+CMEE=1\r"), commandGeneric));
+#if SIM800L_ENABLE_PIN
+        if (_savedPin.length() > 0) TASK_WAIT_UNTIL(task, _taskCommand(task, "AT+CPIN=" + _savedPin + "\r", commandPin));
+#endif
+#if SIM800L_ENABLE_SMS
+        if (_savedSmsMode == 0) TASK_WAIT_UNTIL(task, _taskCommand(task, F("AT+CMGF=0\r"), commandGeneric));
+        if (_savedSmsMode == 1) TASK_WAIT_UNTIL(task, _taskCommand(task, F("AT+CMGF=1\r"), commandGeneric));
+        if (_smsDelivery != SMS_MODE_UNSET) TASK_WAIT_UNTIL(task, _taskCommand(task, "AT+CNMI=2," + String(_smsDelivery) + ",0,1,0\r", commandGeneric));
+#endif
+#if SIM800L_ENABLE_CALL
+        if (_callerIdEnabled) TASK_WAIT_UNTIL(task, _taskCommand(task, F("AT+CLIP=1\r"), commandGeneric));
+        if (_callerIdEnabled) TASK_WAIT_UNTIL(task, _taskCommand(task, F("AT+COLP=1\r"), commandGeneric));
+#endif
+#if SIM800L_ENABLE_DTMF
+        if (_dtmfEnabled) TASK_WAIT_UNTIL(task, _taskCommand(task, F("AT+DDET=1\r"), commandGeneric));
+#endif
+        if (_bearerActive) TASK_SPAWN(task, _recoveryTask, _bearerTask(_recoveryTask));
+
+        _recovering = false;
+        if (onRecovery != NULL) onRecovery(task.retries, true);
+    }
+
+    task.success = true;
+
+    TASK_END(task);
+}
+#endif
+
+#if SIM800L_ENABLE_RTC
+bool Sim800L::_updateRtcTask(Sim800LTask &task)
+{
+    TASK_BEGIN(task);
+
+    TASK_SPAWN(task, _childTask, _bearerTask(_childTask));
+
+    // +CIPGSMLOC: 0,2021/02/19,09:01:00
+    TASK_WAIT_UNTIL(task, _taskCommand(task, F("AT+CIPGSMLOC=2,1\r\n"), commandLocation));
+    task.success = _commandStatus == commandOk && _commandResponse.indexOf(F("+CIPGSMLOC: 0,")) != -1;
+    if (task.success)
+    {
+        int start = _commandResponse.indexOf(F("+CIPGSMLOC:")) + 12;
+        _taskText = _rtcCommand(_commandResponse.substring(start, _commandResponse.indexOf('\n', start)), _taskUtc);
+    }
+
+    TASK_WAIT_UNTIL(task, _taskCommand(task, F("AT+SAPBR=0,1\r\n"), commandBearer));
+    if (!task.success) TASK_EXIT(task, false);
+
+    TASK_WAIT_UNTIL(task, _taskCommand(task, _taskText, commandGeneric));
+    task.success = _commandStatus == commandOk;
+
+    TASK_END(task);
+}
+#endif
+
+#if SIM800L_ENABLE_FTP
+/*
+ * AT+FTPCID=1	FTP over the bearer profile 1, see activateBearerProfile()
+ * AT+FTPPORT=<port>
+ * AT+FTPSERV="<server>", AT+FTPUN="<user>", AT+FTPPW="<password>"
+ */
+bool Sim800L::ftpBegin(const char *server, const char *user, const char *password, uint16_t port)
+{
+    this->SoftwareSerial::print(F("AT+FTPCID=1\r"));
+    if (!_isOk(_readSerial()))
+    {
+        return false;
+    }
+
+    Sim800LCommand command(*this);
+    command.print(F("AT+FTPPORT="));
+    command.print(port);
+    command.print(F("\r"));
+    command.send();
+    if (!_isOk(_readSerial()))
+    {
+        return false;
+    }
+
+    return _ftpCommand(F("AT+FTPSERV="), server)
+        && _ftpCommand(F("AT+FTPUN="), user)
+        && _ftpCommand(F("AT+FTPPW="), password);
+}
+
+/*
+ * Download path/name, from offset, in chunks of FTP_CHUNK_SIZE bytes given
+ * to onData as they arrive. onData returns false to stop the transfer.
+ * Returns the bytes received, -1 on error (see getLastError()).
+ */
+long Sim800L::ftpGet(const char *path, const char *name, bool (*onData)(const uint8_t *data, uint16_t length), uint32_t offset)
+{
+    return _ftpGet(path, name, offset, onData, NULL);
+}
+
+// Same, written to out (an SD file...)
+long Sim800L::ftpGet(const char *path, const char *name, Print &out, uint32_t offset)
+{
+    return _ftpGet(path, name, offset, NULL, &out);
+}
+
+/*
+ * Upload to path/name the data that onData puts in its buffer, returning the
+ * length, 0 at the end. append adds to the remote file, to resume an upload
+ * with the data following what the server already has.
+ * Returns the bytes sent, -1 on error (see getLastError()).
+ */
+long Sim800L::ftpPut(const char *path, const char *name, uint16_t (*onData)(uint8_t *data, uint16_t size), bool append)
+{
+    return _ftpPut(path, name, append, onData, NULL);
+}
+
+// Same, read from in (an SD file...) until its end
+long Sim800L::ftpPut(const char *path, const char *name, Stream &in, bool append)
+{
+    return _ftpPut(path, name, append, NULL, &in);
+}
+
+/*
+ * AT+FTPGETPATH="<path>", AT+FTPGETNAME="<name>"
+ * AT+FTPREST=<offset>	Start from offset
+ * AT+FTPGET=1	Open the session, +FTPGET: 1,1 when data is available
+ * AT+FTPGET=2,<reqlength>	+FTPGET: 2,<cnflength> followed by the data
+ * +FTPGET: 1,0 reports the end of the file, 1,<error> a failure.
+ */
+long Sim800L::_ftpGet(const char *path, const char *name, uint32_t offset, bool (*onData)(const uint8_t *data, uint16_t length), Print *out)
+{
+    if (!_ftpCommand(F("AT+FTPGETPATH="), path) || !_ftpCommand(F("AT+FTPGETNAME="), name))
+    {
+        return -1;
+    }
+
+    Sim800LCommand command(*this);
+    command.print(F("AT+FTPREST="));
+    command.print(offset);
+    command.print(F("\r"));
+    command.send();
+    if (!_isOk(_readSerial()))
+    {
+        return -1;
+    }
+
+    // Can take up to 75 seconds
+    _ftpStatus = FTP_STATUS_NONE;
+    this->SoftwareSerial::print(F("AT+FTPGET=1\r"));
+    if (!_ftpResult(TIME_OUT_READ_SERIAL) || !_ftpWaitStatus(FTP_TIME_OUT) || _ftpStatus != 1)
+    {
+        return -1;
+    }
+
+    uint8_t chunk[FTP_CHUNK_SIZE];
+    long total = 0;
+
+    while (true)
+    {
+        // Only reports arriving from now on are new
+        if (_ftpStatus == 1) _ftpStatus = FTP_STATUS_NONE;
+
+        command.print(F("AT+FTPGET=2,"));
+        command.print(FTP_CHUNK_SIZE);
+        command.print(F("\r"));
+        command.send();
+
+        String line;
+        do
+        {
+            line = _ftpLine(FTP_DATA_TIME_OUT);
+            if (line.length() == 0 || _isError(line)) return -1;
+        }
+        while (!line.startsWith(F("+FTPGET: 2,")));
+
+        uint16_t length = line.substring(11).toInt();
+        if (length > FTP_CHUNK_SIZE) length = FTP_CHUNK_SIZE;
+        if (_readBytes(chunk, length, FTP_DATA_TIME_OUT) != length || !_ftpResult(FTP_DATA_TIME_OUT))
+        {
+            return -1;
+        }
+
+        if (length > 0)
+        {
+            total += length;
+            if (out != NULL) out->write(chunk, length);
+            if (onData != NULL && !onData(chunk, length))
             {
-            // need to wait for the first CR
-            Serial.print(_buffer[i]);
-            Serial.print(" --- ");
-            Serial.println(_buffer[i], HEX);
-            }*/
-         
-            if(i>0 && _buffer[i-1] == '\r' && _buffer[i] == '\n')
+                this->SoftwareSerial::print(F("AT+FTPQUIT\r"));
+                _readSerial();
+                return total;
+            }
+            continue;
+        }
+
+        // Nothing buffered yet: wait for more data (1,1) or the end (1,0)
+        if (_ftpStatus == FTP_STATUS_NONE && !_ftpWaitStatus(FTP_TIME_OUT))
+        {
+            return -1;
+        }
+        if (_ftpStatus == 0) return total;
+        if (_ftpStatus != 1) return -1;
+    }
+}
+
+/*
+ * AT+FTPPUTPATH="<path>", AT+FTPPUTNAME="<name>"
+ * AT+FTPPUTOPT="APPE"	Append to the remote file, "STOR" replaces it
+ * AT+FTPPUT=1	Open the session, +FTPPUT: 1,1,<maxlength> when ready
+ * AT+FTPPUT=2,<reqlength>	+FTPPUT: 2,<cnflength>, then the module takes
+ *		the data, and reports 1,1,<maxlength> when ready for more
+ * AT+FTPPUT=2,0	End of the file, +FTPPUT: 1,0 once it is stored
+ */
+long Sim800L::_ftpPut(const char *path, const char *name, bool append, uint16_t (*onData)(uint8_t *data, uint16_t size), Stream *in)
+{
+    if (!_ftpCommand(F("AT+FTPPUTPATH="), path) || !_ftpCommand(F("AT+FTPPUTNAME="), name)
+        || !_ftpCommand(F("AT+FTPPUTOPT="), append ? "APPE" : "STOR"))
+    {
+        return -1;
+    }
+
+    // Can take up to 75 seconds
+    _ftpStatus = FTP_STATUS_NONE;
+    this->SoftwareSerial::print(F("AT+FTPPUT=1\r"));
+    if (!_ftpResult(TIME_OUT_READ_SERIAL) || !_ftpWaitStatus(FTP_TIME_OUT) || _ftpStatus != 1)
+    {
+        return -1;
+    }
+
+    uint8_t chunk[FTP_CHUNK_SIZE];
+    Sim800LCommand command(*this);
+    long total = 0;
+    uint16_t length;
+
+    do
+    {
+        uint16_t size = _ftpMaxLength < FTP_CHUNK_SIZE ? _ftpMaxLength : FTP_CHUNK_SIZE;
+        length = in != NULL ? in->readBytes(chunk, size) : onData(chunk, size);
+        _ftpStatus = FTP_STATUS_NONE;
+
+        command.print(F("AT+FTPPUT=2,"));
+        command.print(length);
+        command.print(F("\r"));
+        command.send();
+        if (length == 0) break;
+
+        String line;
+        do
+        {
+            line = _ftpLine(FTP_DATA_TIME_OUT);
+            if (line.length() == 0 || _isError(line)) return -1;
+        }
+        while (!line.startsWith(F("+FTPPUT: 2,")));
+
+        write(chunk, length);
+        if (!_ftpResult(FTP_DATA_TIME_OUT))
+        {
+            return -1;
+        }
+        total += length;
+
+        if (_ftpStatus == FTP_STATUS_NONE && !_ftpWaitStatus(FTP_TIME_OUT))
+        {
+            return -1;
+        }
+    }
+    while (_ftpStatus == 1);
+
+    if (length != 0) return -1;
+
+    if (!_ftpResult(FTP_DATA_TIME_OUT) || (_ftpStatus == FTP_STATUS_NONE && !_ftpWaitStatus(FTP_TIME_OUT)))
+    {
+        return -1;
+    }
+    return _ftpStatus == 0 ? total : -1;
+}
+
+// <command>"<argument>", true on OK
+bool Sim800L::_ftpCommand(const __FlashStringHelper *command, const char *argument)
+{
+    Sim800LCommand line(*this);
+    line.print(command);
+    line.print(F("\""));
+    line.print(argument);
+    line.print(F("\"\r"));
+    line.send();
+
+    return _isOk(_readSerial());
+}
+
+// Lines up to the final result of a command
+bool Sim800L::_ftpResult(uint32_t timeout)
+{
+    while (true)
+    {
+        String line = _ftpLine(timeout);
+        if (line.length() == 0 || _isError(line)) return false;
+        if (_isOk(line)) return true;
+    }
+}
+
+// Lines up to the next +FTPGET/+FTPPUT: 1,<status> report
+bool Sim800L::_ftpWaitStatus(uint32_t timeout)
+{
+    while (_ftpStatus == FTP_STATUS_NONE)
+    {
+        if (_ftpLine(timeout).length() == 0) return false;
+    }
+    return true;
+}
+
+// A line of the transfer, the session reports are kept in _ftpStatus
+String Sim800L::_ftpLine(uint32_t timeout)
+{
+    String line = _readLine(timeout);
+
+    if (line.startsWith(F("+FTPGET: 1,")) || line.startsWith(F("+FTPPUT: 1,")))
+    {
+        // +FTPPUT: 1,1,<maxlength>
+        _ftpStatus = line.substring(11).toInt();
+        int comma = line.indexOf(',', 11);
+        if (comma != -1) _ftpMaxLength = line.substring(comma + 1).toInt();
+        if (_ftpStatus > 1)
+        {
+            _lastError = errorFtp;
+            _lastErrorCode = _ftpStatus;
+        }
+    }
+    else if (line.length() == 0)
+    {
+        _lastError = errorTimeout;
+        _lastErrorCode = 0;
+    }
+    else if (_isError(line))
+    {
+        _setLastError(line);
+    }
+    else
+    {
+        String urc = line;
+        urc.trim();
+        _handleUrc(urc);
+    }
+    return line;
+}
+
+/*
+ * Next line with its <CR>, "" on timeout. What follows the <LF> stays in
+ * the RX buffer, the data of AT+FTPGET=2 is read by _readBytes().
+ */
+String Sim800L::_readLine(uint32_t timeout)
+{
+    String line;
+    uint32_t timeOld = millis();
+    bool complete = false;
+
+    _setRxReady(true);
+
+    while (!complete && millis() - timeOld < timeout)
+    {
+        if (this->SoftwareSerial::available() <= 0)
+        {
+            _idle(timeOld);
+            continue;
+        }
+
+        char c = (char) read();
+        if (c == '\n')
+        {
+            // empty lines between the answers
+            complete = line.length() > 1;
+            if (!complete) line = "";
+            continue;
+        }
+        if (line.length() < URC_LINE_MAX_LENGTH) line += c;
+
+        // numeric result code of the compact mode, without <LF>
+        if (_compactMode && c == '\r' && line.length() == 2 && isdigit(line[0])) complete = true;
+    }
+
+    _setRxReady(false);
+    _checkOverflow();
+
+    if (!complete) line = "";
+    return line;
+}
+
+uint16_t Sim800L::_readBytes(uint8_t *buffer, uint16_t length, uint32_t timeout)
+{
+    uint16_t count = 0;
+    uint32_t timeOld = millis();
+
+    _setRxReady(true);
+
+    while (count < length && millis() - timeOld < timeout)
+    {
+        if (this->SoftwareSerial::available() > 0) buffer[count++] = read();
+        else _idle(timeOld);
+    }
+
+    _setRxReady(false);
+    _checkOverflow();
+    return count;
+}
+#endif
+
+#if SIM800L_ENABLE_OPERATOR
+bool Sim800L::_scanOperators()
+{
+    // Can take up to 45 seconds
+
+    this->SoftwareSerial::print(F("AT+COPS=?\r"));
+
+    OperatorInfo info;
+    char line[12];				// start of the lines outside the tuples, for OK/ERROR
+    uint8_t lineLength = 0;
+    uint8_t field = 0;
+    uint8_t fieldLength = 0;
+    bool inTuple = false;
+    bool inQuotes = false;
+    uint8_t status = 0;
+
+    uint32_t timeOld = millis();
+    uint32_t timeout = getCommandTimeout(commandNetworkScan);
+    _setRxReady(true);
+
+    while (millis() - timeOld < timeout)
+    {
+        if (this->SoftwareSerial::available() == 0)
+        {
+            _idle(timeOld);
+            continue;
+        }
+
+        char c = (char) read();
+
+        if (inTuple)
+        {
+            char *target = NULL;
+            uint8_t size = 0;
+
+            if (field == 1)			{ target = info.longName; size = sizeof(info.longName); }
+            else if (field == 2)	{ target = info.shortName; size = sizeof(info.shortName); }
+            else if (field == 3)	{ target = info.numeric; size = sizeof(info.numeric); }
+
+            if (c == '"')
             {
-                if(firstIndexHandle == 0)
+                inQuotes = !inQuotes;
+            }
+            else if (inQuotes)
+            {
+                if (target != NULL && fieldLength < size - 1)
                 {
-                    firstIndexHandle = i+1;
-
-                    //hasMeetFirstCrlf = true;
+                    target[fieldLength++] = c;
+                    target[fieldLength] = '\0';
                 }
-                else{
-                    lastIndexHandle = i-1;
-                    // we are at the end of the line. Need to send info
-                    if(firstIndexHandle > 0 && lastIndexHandle > firstIndexHandle)
-                    {
-                        if(onStatusReport != NULL){
-                            onStatusReport(_buffer.substring(firstIndexHandle, lastIndexHandle));
-                        }
-                    }
+            }
+            else if (c == ',')
+            {
+                field++;
+                fieldLength = 0;
+            }
+            else if (c == ')')
+            {
+                inTuple = false;
+                // (0-4),(0-2) at the end of the answer have a single field
+                if (field >= 3)
+                {
+                    info.status = (OperatorStatus) status;
+                    _onOperator(info);
                 }
-              
             }
+            else if (field == 0 && c >= '0' && c <= '9')
+            {
+                status = status * 10 + (c - '0');
+            }
+            continue;
+        }
+
+        if (c == '(')
+        {
+            inTuple = true;
+            inQuotes = false;
+            field = 0;
+            fieldLength = 0;
+            status = 0;
+            info.longName[0] = info.shortName[0] = info.numeric[0] = '\0';
+            continue;
         }
 
+        if (c == '\n' || c == '\r')
+        {
+            line[lineLength] = '\0';
+            if (strcmp(line, "OK") == 0 || (_compactMode && strcmp(line, "0") == 0))
+            {
+                _setRxReady(false);
+                _updateLatency(commandNetworkScan, millis() - timeOld);
+                _lastError = errorNone;
+                _lastErrorCode = 0;
+                return true;
+            }
+            if (strstr(line, "ERROR") != NULL || (_compactMode && strcmp(line, "4") == 0))
+            {
+                _setRxReady(false);
+                _setLastError(String(line) + '\r');
+                return false;
+            }
+            lineLength = 0;
+        }
+        else if (lineLength < sizeof(line) - 1)
+        {
+            line[lineLength++] = c;
+        }
     }
 
-    firstIndexHandle = 0;
-    lastIndexHandle = 0;
-    int indexOfCMT = _buffer.indexOf(F("+CMT:"));
+    _setRxReady(false);
+    _latencyTimeout(commandNetworkScan);
+    _lastError = errorTimeout;
+    _lastErrorCode = 0;
+    return false;
+}
 
-    while(indexOfCMT != -1){
-    // Here we receive a new message
-    // Response format
-    //+CMT: "",135\r\n
-    //07913366003000F0240B913356108867F800001220919013734084C170381C0E87C3E170381C0E87C3E170381C0E87C3E1B05EAFD7EBF57ABD7E3E9FCFCF67341AAD56ABD56A75BD9E4AD3631ADA9FBEBC97AE3DE84974EFDE8436DFAD3872C68C62152C68C92399C29396BD964A31634AA56BD6A59CD6\r\n
+void Sim800L::_onOperator(const OperatorInfo &info)
+{
+    if (_operatorCallback != NULL) _operatorCallback(info);
 
-        for(int i = indexOfCMT; i < _buffer.length(); i++)
+    if (info.status != operatorAvailable && info.status != operatorCurrent) return;
+
+    if (_operatorAllowed != NULL)
+    {
+        bool allowed = false;
+        for (uint8_t i = 0; i < _operatorAllowedCount && !allowed; i++)
         {
-           
-            // need to wait for the first CR
-           /* Serial.print(_buffer[i]);
-            Serial.print(" --- ");
-            Serial.println(_buffer[i], HEX);*/
-            
-         
-            if(i>0 && (_buffer[i-1] == '\r' && _buffer[i] == '\n') || (_buffer[i] == '\n'))
-            {
-                if(firstIndexHandle == 0)
-                {
-                    firstIndexHandle = i+1;
+            allowed = strcmp(_operatorAllowed[i], info.numeric) == 0;
+        }
+        if (!allowed) return;
+    }
 
-                    //hasMeetFirstCrlf = true;
-                }
-                else{
+    // First available one, unless the current one is allowed
+    if (_bestOperator.status == operatorUnknown || info.status == operatorCurrent)
+    {
+        _bestOperator = info;
+    }
+}
+#endif
 
-                    if(_buffer[i-1] == '\r')
-                    {lastIndexHandle = i-1;}
-                    else
-                    {lastIndexHandle = i;}
-                    // we are at the end of the line. Need to send info
-                    if(firstIndexHandle > 0 && lastIndexHandle > firstIndexHandle)
-                    {
-                        if(onNewMessage != NULL){
-                             onNewMessage(_buffer.substring(firstIndexHandle, lastIndexHandle));
-                        }
+#if SIM800L_ENABLE_SMS || SIM800L_ENABLE_USSD
+static uint8_t hexToByte(const String &hex, int index)
+{
+    uint8_t value = 0;
+    for (uint8_t i = 0; i < 2; i++)
+    {
+        char c = hex[index + i];
+        value <<= 4;
+        if (c >= '0' && c <= '9')		value |= c - '0';
+        else if (c >= 'A' && c <= 'F')	value |= c - 'A' + 10;
+        else if (c >= 'a' && c <= 'f')	value |= c - 'a' + 10;
+    }
+    return value;
+}
 
-                        // Check all messages in the _buffer. Indeed, we can have more than one message
-                        indexOfCMT = _buffer.indexOf(F("+CMT:"), lastIndexHandle); // add the header '+CMT:' length
-                        firstIndexHandle = 0;
-                        
-                    }
-                }
-              
+/*
+ * Text of a UCS2 message (DCS 8), as readSms returns it in hex, converted to
+ * UTF-8 in place: the result is never longer than the hex. Returns false,
+ * leaving the text untouched, if it is not hex UCS2. USSD answers (DCS 72)
+ * go through it before onUssd.
+ */
+bool Sim800L::decodeUcs2(String &text)
+{
+    text.trim();
+    unsigned int length = text.length();
+    if (length == 0 || length % 4 != 0) return false;
+    for (unsigned int i = 0; i < length; i++)
+    {
+        if (!isxdigit(text[i])) return false;
+    }
+
+    unsigned int out = 0;
+    for (unsigned int in = 0; in < length; in += 4)
+    {
+        uint32_t c = ((uint16_t) hexToByte(text, in) << 8) | hexToByte(text, in + 2);
+
+        // surrogate pair
+        if (c >= 0xD800 && c < 0xDC00 && in + 8 <= length)
+        {
+            uint16_t low = ((uint16_t) hexToByte(text, in + 4) << 8) | hexToByte(text, in + 6);
+            if (low >= 0xDC00 && low < 0xE000)
+            {
+                c = 0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00);
+                in += 4;
             }
         }
+
+        if (c < 0x80)
+        {
+            text.setCharAt(out++, c);
+        }
+        else if (c < 0x800)
+        {
+            text.setCharAt(out++, 0xC0 | (c >> 6));
+            text.setCharAt(out++, 0x80 | (c & 0x3F));
+        }
+        else if (c < 0x10000)
+        {
+            text.setCharAt(out++, 0xE0 | (c >> 12));
+            text.setCharAt(out++, 0x80 | ((c >> 6) & 0x3F));
+            text.setCharAt(out++, 0x80 | (c & 0x3F));
+        }
+        else
+        {
+            text.setCharAt(out++, 0xF0 | (c >> 18));
+            text.setCharAt(out++, 0x80 | ((c >> 12) & 0x3F));
+            text.setCharAt(out++, 0x80 | ((c >> 6) & 0x3F));
+            text.setCharAt(out++, 0x80 | (c & 0x3F));
+        }
+    }
+    text.remove(out);
+    return true;
+}
+#endif
+
+#if SIM800L_ENABLE_SMS
+// Each UTF-8 character is written as 4 hex digits, 8 beyond U+FFFF
+void Sim800L::_printUcs2(const char *text)
+{
+    static const char digits[] = "0123456789ABCDEF";
+
+    while (*text != '\0')
+    {
+        uint32_t c = (uint8_t) *text++;
+        uint8_t more = 0;
+
+        if (c >= 0xF0)		{ c &= 0x07; more = 3; }
+        else if (c >= 0xE0)	{ c &= 0x0F; more = 2; }
+        else if (c >= 0xC0)	{ c &= 0x1F; more = 1; }
+        while (more > 0 && (*text & 0xC0) == 0x80)
+        {
+            c = (c << 6) | (*text++ & 0x3F);
+            more--;
+        }
+
+        uint16_t unit[2] = { (uint16_t) c, 0 };
+        uint8_t units = 1;
+        if (c > 0xFFFF)
+        {
+            c -= 0x10000;
+            unit[0] = 0xD800 | (c >> 10);
+            unit[1] = 0xDC00 | (c & 0x3FF);
+            units = 2;
+        }
+        for (uint8_t i = 0; i < units; i++)
+        {
+            for (int8_t shift = 12; shift >= 0; shift -= 4) write(digits[(unit[i] >> shift) & 0x0F]);
+        }
+    }
+}
+
+void Sim800L::_trackSubmit(int reference)
+{
+    if (reference < 0) return;
+
+    // Same reference first (the 8 bit counter wrapped, the old entry is
+    // stale), then a free entry, then the oldest one
+    uint8_t slot = DELIVERY_TABLE_SIZE;
+    for (uint8_t i = 0; i < DELIVERY_TABLE_SIZE && slot == DELIVERY_TABLE_SIZE; i++)
+    {
+        if (_deliveries[i].reference == reference) slot = i;
+    }
+    for (uint8_t i = 0; i < DELIVERY_TABLE_SIZE && slot == DELIVERY_TABLE_SIZE; i++)
+    {
+        if (_deliveries[i].reference == DELIVERY_FREE) slot = i;
+    }
+    if (slot == DELIVERY_TABLE_SIZE)
+    {
+        slot = 0;
+        for (uint8_t i = 1; i < DELIVERY_TABLE_SIZE; i++)
+        {
+            if (_deliveries[slot].submitted - _deliveries[i].submitted < 0x80000000UL) slot = i;
+        }
     }
-    
-    //return _buffer;
-	 // +CMTI: "SM",1
-	// if(_buffer.indexOf("+CMTI:") == -1)
-	// {
-	// 	return 0;
-	// }
-	// return _buffer.substring(_buffer.indexOf(',')+1).toInt();
+
+    // Table full: the oldest entry gives up
+    if (_deliveries[slot].reference != DELIVERY_FREE) _reportDelivery(slot, DELIVERY_STATUS_TIME_OUT, NULL);
+
+    _deliveries[slot].reference = reference;
+    _deliveries[slot].submitted = millis();
 }
 
-const uint8_t Sim800L::checkForSMS()
+/*
+ * SMS-STATUS-REPORT pdu (3GPP TS 23.040 9.2.2.3)
+ * SMSC | first octet | TP-MR | TP-RA | TP-SCTS | TP-DT | TP-ST
+ */
+void Sim800L::_trackStatusReport(const String &pdu)
 {
-	 _buffer = _readSerial(100);
-	 if(_buffer.length() == 0)
-	 {
-	 	return 0;
-	 }
-     _buffer += _readSerial(1000);
-     
-	 // +CMTI: "SM",1
-	 if(_buffer.indexOf(F("+CMTI:")) == -1)
-	 {
-	 	return 0;
-	 }
-	 return _buffer.substring(_buffer.indexOf(',')+1).toInt();
-}
+    int index = (hexToByte(pdu, 0) + 1) * 2;	// skip SMSC
+    index += 2;									// first octet
 
+    if ((int) pdu.length() < index + 4) return;
 
-String Sim800L::getNumberSms(uint8_t index)
-{
-    _buffer=readSms(index);
-    //Serial.println(_buffer.length());
-    if (_buffer.length() > 10) //avoid empty sms
+    uint8_t reference = hexToByte(pdu, index);
+    index += 2;
+
+    uint8_t digits = hexToByte(pdu, index);
+    index += 4 + ((digits + 1) / 2) * 2;		// length, type of address, semi-octets
+    index += 14;								// TP-SCTS
+
+    if ((int) pdu.length() < index + 16) return;
+
+    // TP-DT, semi-octets yy MM dd hh mm ss, time zone ignored
+    char discharge[18];
+    const char separators[] = "//,::";
+    uint8_t position = 0;
+    for (uint8_t i = 0; i < 6; i++)
     {
-        uint8_t _idx1=_buffer.indexOf(F("+CMGR:"));
-        _idx1=_buffer.indexOf("\",\"",_idx1+1);
-        return _buffer.substring(_idx1+3,_buffer.indexOf("\",\"",_idx1+4));
+        discharge[position++] = pdu[index + 1];
+        discharge[position++] = pdu[index];
+        if (i < 5) discharge[position++] = separators[i];
+        index += 2;
     }
-    else
+    discharge[position] = '\0';
+    index += 2;
+
+    uint8_t status = hexToByte(pdu, index);
+
+    for (uint8_t i = 0; i < DELIVERY_TABLE_SIZE; i++)
     {
-        return "";
+        if (_deliveries[i].reference != reference) continue;
+
+        // 0x20..0x3F: the SC is still trying, a final report follows
+        if (status >= 0x20 && status <= 0x3F) return;
+
+        _reportDelivery(i, status, discharge);
+        return;
     }
 }
 
-String Sim800L::readSms(uint8_t index)
+void Sim800L::_reportDelivery(uint8_t slot, uint8_t status, const char *dischargeTime)
 {
-    // Can take up to 5 seconds
+    SmsDeliveryReport report;
+    report.reference = _deliveries[slot].reference;
+    report.status = status;
+    report.latency = millis() - _deliveries[slot].submitted;
+    report.dischargeTime = dischargeTime != NULL ? dischargeTime : "";
 
-    if(( _readSerial(5000).indexOf("ER")) != -1)
+    _deliveries[slot].reference = DELIVERY_FREE;
+
+    if (onDeliveryReport != NULL) onDeliveryReport(report);
+}
+#endif
+
+bool Sim800L::_handleUrc(const String &line)
+{
+    if (line == F("SMS Ready"))
     {
-    	return "";
+        _smsReady = true;
+        return true;
     }
 
-    this->SoftwareSerial::print (F("AT+CMGR="));
-    this->SoftwareSerial::print (index);
-    this->SoftwareSerial::print ("\r");
-    _buffer=_readSerial();
-   //Serial.println("Received !!");
-   //Serial.println(_buffer);
-    if (_buffer.indexOf(F("CMGR=")) == -1)
+#if SIM800L_ENABLE_WATCHDOG
+    // UNDER-VOLTAGE POWER DOWN, OVER-VOLTAGE POWER DOWN, NORMAL POWER DOWN
+    if (line.endsWith(F("POWER DOWN")))
     {
-    	return "";
+        _powerDown = true;
+        _smsReady = false;
+        return true;
     }
+#endif
 
-    //Serial.println(_buffer);
-	_buffer = _readSerial(10000);
-	byte first = _buffer.indexOf('\n', 2) + 1;
-	byte second = _buffer.indexOf('\n', first);
-    return _buffer.substring(first, second);
-}
+#if SIM800L_ENABLE_USSD
+    if (line.startsWith(F("+CUSD:")))
+    {
+        _handleUssd(line);
+        return true;
+    }
+#endif
 
+#if SIM800L_ENABLE_CALL
+    if (_handleCallUrc(line)) return true;
+#endif
+    return false;
+}
 
-bool Sim800L::delAllSms()
+#if SIM800L_ENABLE_SMS
+// +CMT: <header> then the message, +CMTI: "SM",<index>, +CDS: <length> then the pdu
+bool Sim800L::_handleSmsUrc(const String &line)
 {
-    // Can take up to 25 seconds
+    if (_smsBodyPending)
+    {
+        _smsBodyPending = false;
+        // A view of the line buffer, no copy
+        if (onSms != NULL) onSms(_smsHeader, line.c_str(), line.length());
+        else if (onNewMessage != NULL) onNewMessage(line);
+        return true;
+    }
 
-    this->SoftwareSerial::print(F("AT+CMGD=4\r"));
-    _buffer=_readSerial(25000);
-    
-    if ( (_buffer.indexOf(F("ER"))) == -1)
+    if (_statusReportPending)
     {
-        return false;
+        _statusReportPending = false;
+        if (onStatusReport != NULL) onStatusReport(line);
+        _trackStatusReport(line);
+        return true;
     }
-    else return true;
-    // Error found, return 1
-    // Error NOT found, return 0
-}
 
+    // In text mode the report is the +CDS line itself, only pdus are tracked
+    if (line.startsWith(F("+CDS:")))
+    {
+        if (line.indexOf(',') == -1) _statusReportPending = true;
+        else if (onStatusReport != NULL) onStatusReport(line);
+        return true;
+    }
 
-void Sim800L::RTCtime(int *day,int *month, int *year,int *hour,int *minute, int *second)
-{
-    this->SoftwareSerial::print(F("at+cclk?\r\n"));
-    // if respond with ERROR try one more time.
-    _buffer=_readSerial();
-    if ((_buffer.indexOf(F("ERR")))!=-1)
+    if (line.startsWith(F("+CMT:")))
     {
-        delay(50);
-        this->SoftwareSerial::print(F("at+cclk?\r\n"));
+        _parseSmsHeader(line, 0);
+        _smsBodyPending = true;
+        return true;
     }
-    if ((_buffer.indexOf(F("ERR")))==-1)
+
+    if (line.startsWith(F("+CMTI:")))
     {
-        _buffer=_buffer.substring(_buffer.indexOf("\"")+1,_buffer.lastIndexOf("\"")-1);
-        *year=_buffer.substring(0,2).toInt();
-        *month= _buffer.substring(3,5).toInt();
-        *day=_buffer.substring(6,8).toInt();
-        *hour=_buffer.substring(9,11).toInt();
-        *minute=_buffer.substring(12,14).toInt();
-        *second=_buffer.substring(15,17).toInt();
+        _smsUsed++;
+        if (onSmsStored != NULL) onSmsStored(atoi(line.c_str() + line.indexOf(',') + 1));
+        return true;
     }
+    return false;
 }
 
-//Get the time  of the base of GSM
-String Sim800L::dateNet()
+// Characters from..to of data, cut to size
+static void copyField(const String &data, int from, int to, char *out, uint8_t size)
 {
-    this->SoftwareSerial::print(F("AT+CIPGSMLOC=2,1\r\n "));
-    _buffer=_readSerial();
-
-    if (_buffer.indexOf("OK")!=-1 )
-    {
-        return _buffer.substring(_buffer.indexOf(":")+2,(_buffer.indexOf("OK")-4));
-    }
-    else
-        return "0";
+    uint8_t length = 0;
+    while (from < to && length < size - 1) out[length++] = data[from++];
+    out[length] = '\0';
 }
 
-// Update the RTC of the module with the date of GSM.
-bool Sim800L::updateRtc(int utc)
+/*
+ * +CMT: "<oa>",[<alpha>],"<scts>"[,...]	text mode
+ * +CMT: [<alpha>],<length>					PDU mode
+ */
+void Sim800L::_parseSmsHeader(const String &data, int start)
 {
+    int end = data.indexOf('\r', start);
+    if (end == -1) end = data.length();
 
-    activateBearerProfile();
-    _buffer=dateNet();
-    deactivateBearerProfile();
+    int quotes[6];
+    uint8_t count = 0;
+    for (int i = start; i < end && count < 6; i++)
+    {
+        if (data[i] == '"') quotes[count++] = i;
+    }
 
-    _buffer=_buffer.substring(_buffer.indexOf(",")+1,_buffer.length());
-    String dt=_buffer.substring(0,_buffer.indexOf(","));
-    String tm=_buffer.substring(_buffer.indexOf(",")+1,_buffer.length()) ;
+    _smsNumber[0] = '\0';
+    _smsTime[0] = '\0';
+    _smsHeader.pduLength = 0;
+    _smsHeader.pdu = count <= 2;
 
-    int hour = tm.substring(0,2).toInt();
-    int day = dt.substring(8,10).toInt();
+    if (_smsHeader.pdu)
+    {
+        _smsHeader.pduLength = atoi(data.c_str() + data.lastIndexOf(',', end) + 1);
+        return;
+    }
+    copyField(data, quotes[0] + 1, quotes[1], _smsNumber, SMS_NUMBER_SIZE);
 
-    hour=hour+utc;
+    // <alpha> is quoted ("" or a name) or left out
+    uint8_t time = count >= 4 && quotes[2] == quotes[1] + 2 ? 4 : 2;
+    if (count >= time + 2) copyField(data, quotes[time] + 1, quotes[time + 1], _smsTime, SMS_TIME_SIZE);
+}
+#endif
 
-    String tmp_hour;
-    String tmp_day;
-    //TODO : fix if the day is 0, this occur when day is 1 then decrement to 1,
-    //       will need to check the last month what is the last day .
-    if (hour<0)
+#if SIM800L_ENABLE_USSD
+// +CUSD: <status>[,"<text>",<dcs>]
+void Sim800L::_handleUssd(const String &line)
+{
+    int status = line.substring(6).toInt();
+    int quote = line.indexOf('"');
+    int close = line.lastIndexOf('"');
+
+    _ussdText = "";
+    if (quote != -1 && close > quote)
     {
-        hour+=24;
-        day-=1;
+        _ussdText = line.substring(quote + 1, close);
+        _ussdText.replace(F("\r"), F(""));
+        // 72 (0x48): UCS2, in hex
+        if (line.substring(close + 2).toInt() == 72) decodeUcs2(_ussdText);
     }
-    if (hour<10)
-    {
 
-        tmp_hour="0"+String(hour);
-    }
-    else
+    _ussdStatus = status >= ussdDone && status <= ussdNetworkTimeout ? (UssdStatus) status : ussdError;
+    if (onUssd != NULL) onUssd(_ussdStatus, _ussdText);
+}
+
+void Sim800L::_ussdEnd(UssdStatus status)
+{
+    _ussdStatus = status;
+    _ussdText = "";
+    if (onUssd != NULL) onUssd(_ussdStatus, _ussdText);
+}
+#endif
+
+#if SIM800L_ENABLE_CALL
+bool Sim800L::_handleCallUrc(const String &line)
+{
+    if (line == F("RING") || (_compactMode && line == F("2")))
     {
-        tmp_hour=String(hour);
+        if (_callState != callIncoming)
+        {
+            _callerNumber = "";
+            _setCallState(callIncoming);
+            // Without caller id the RING is all we will get
+            if (!_callerIdEnabled && onIncomingCall != NULL) onIncomingCall(_callerNumber);
+        }
+        return true;
     }
-    if (day<10)
+
+    if (line.startsWith(F("+CLIP:")))
     {
-        tmp_day="0"+String(day);
+        // +CLIP: "+393331234567",145,"",0,"",0
+        if (_callState == callIncoming && _callerNumber.length() == 0)
+        {
+            int first = line.indexOf('"');
+            _callerNumber = line.substring(first+1, line.indexOf('"', first+1));
+            if (onIncomingCall != NULL) onIncomingCall(_callerNumber);
+        }
+        return true;
     }
-    else
+
+#if SIM800L_ENABLE_DTMF
+    if (line.startsWith(F("+DTMF:")))
     {
-        tmp_day=String(day);
+        // +DTMF: 5
+        char key = line[line.length() - 1];
+        if (onDtmf != NULL) onDtmf(key);
+        if (_callState == callActive) _dtmfKey(key);
+        return true;
     }
-    //for debugging
-    //Serial.println("at+cclk=\""+dt.substring(2,4)+"/"+dt.substring(5,7)+"/"+tmp_day+","+tmp_hour+":"+tm.substring(3,5)+":"+tm.substring(6,8)+"-03\"\r\n");
-    this->SoftwareSerial::print("at+cclk=\""+dt.substring(2,4)+"/"+dt.substring(5,7)+"/"+tmp_day+","+tmp_hour+":"+tm.substring(3,5)+":"+tm.substring(6,8)+"-03\"\r\n");
-    if ( (_readSerial().indexOf("ER"))!=-1)
+#endif
+
+    if (line.startsWith(F("+COLP:")))
     {
+        if (_callState == callDialing)
+        {
+            _setCallState(callActive);
+            if (onCallResult != NULL) onCallResult(callAnswered);
+        }
         return true;
     }
-    else return false;
 
+    CallResult result;
+
+    if (line == F("BUSY"))				result = callBusy;
+    else if (line == F("NO ANSWER"))	result = callNoAnswer;
+    else if (line == F("NO CARRIER"))	result = callNoCarrier;
+    else if (!_compactMode || line.length() != 1) return false;
+    else if (line[0] == '7')			result = callBusy;
+    else if (line[0] == '8')			result = callNoAnswer;
+    else if (line[0] == '3')			result = callNoCarrier;
+    else return false;
 
+    if (_callState == callDialing && onCallResult != NULL) onCallResult(result);
+    _setCallState(callIdle);
+    return true;
 }
 
+void Sim800L::_setCallState(CallState state)
+{
+    CallState previous = _callState;
+    _callState = state;
 
+    if (previous == state) return;
 
-//
-//PRIVATE METHODS
-//
-String Sim800L::_readSerial()
-{
+#if SIM800L_ENABLE_DTMF
+    _dtmfState = DTMF_MENU_START;
+    _dtmfTime = millis();
+#endif
 
-    uint64_t timeOld = millis();
+    if (state == callActive && onCallConnected != NULL) onCallConnected();
+    if (state == callIdle && onCallEnded != NULL) onCallEnded();
+}
+#endif
+
+#if SIM800L_ENABLE_DTMF
+void Sim800L::_dtmfKey(char key)
+{
+    _dtmfTime = millis();
 
-    while (!this->SoftwareSerial::available() && !(millis() > timeOld + TIME_OUT_READ_SERIAL))
+    for (uint8_t i = 0; i < _dtmfMenuCount; i++)
     {
-       // delay(13);
+        const DtmfMenuEntry &entry = _dtmfMenu[i];
+        if (entry.state != _dtmfState) continue;
+        if (entry.key != key && (entry.key != DTMF_KEY_ANY || key == DTMF_KEY_TIME_OUT)) continue;
+
+        _dtmfState = entry.next;
+        if (entry.action != 0 && onDtmfMenu != NULL) onDtmfMenu(entry.action, key);
+        return;
     }
+}
+#endif
 
-    String str;
+/*
+ * Blocking reads may swallow call events, incoming sms and status reports,
+ * or the SMS Ready of a module that restarted, in the middle of a command
+ * response: hand them over to the URC handlers as well.
+ */
+void Sim800L::_dispatchUrcs(const String &data)
+{
+    int start = 0;
 
-    while(this->SoftwareSerial::available())
+    while (start < (int) data.length())
     {
-        if (this->SoftwareSerial::available()>0)
+        // In compact mode result codes end with <CR> only
+        int end = data.indexOf(_compactMode ? '\r' : '\n', start);
+        if (end == -1) end = data.length();
+
+        char first = data[start];
+        if (first == '\n') first = data[++start];
+#if SIM800L_ENABLE_USSD
+        // Up to the line of the closing quote
+        if (first == '+' && data.startsWith(F("+CUSD:"), start))
+        {
+            int quote = data.indexOf('"', start);
+            int close = quote == -1 ? -1 : data.indexOf('"', quote + 1);
+            if (quote != -1 && quote < end && close > end)
+            {
+                end = data.indexOf('\n', close);
+                if (end == -1) end = data.length();
+            }
+        }
+#endif
+#if SIM800L_ENABLE_SMS
+        // With the line after +CMT and +CDS, whatever it starts with
+        if (!_smsUrcsParsed && (first == '+' || _smsBodyPending || _statusReportPending))
+        {
+            String line = data.substring(start, end);
+            line.trim();
+            if (line.length() > 0 && _handleSmsUrc(line))
+            {
+                start = end + 1;
+                continue;
+            }
+        }
+#endif
+        if (first == 'R' || first == '+' || first == 'B' || first == 'N' || first == 'U' || first == 'O' || first == 'S'
+            || (_compactMode && first >= '2' && first <= '8'))
         {
-            str += (char) this->SoftwareSerial::read();
+            String line = data.substring(start, end);
+            line.trim();
+            _handleUrc(line);
         }
+        start = end + 1;
     }
+}
 
-    return str;
+/*
+ * Final result of an answer, "OK"/"ERROR" or the numeric 0/4 of the
+ * compact mode. Only whole lines count, "REGISTER" or an "ERROR" inside
+ * a message are not results.
+ */
+bool Sim800L::_isOk(const String &data)
+{
+    return _hasResult(data, _compactMode ? F("0") : F("OK"));
+}
+
+bool Sim800L::_isError(const String &data)
+{
+    if (data.indexOf(F("+CME ERROR:")) != -1 || data.indexOf(F("+CMS ERROR:")) != -1) return true;
+    return _hasResult(data, _compactMode ? F("4") : F("ERROR"));
+}
+
+// A line made of the result alone, terminated by <CR>
+bool Sim800L::_hasResult(const String &data, const String &result)
+{
+    int index = data.indexOf(result);
+
+    while (index != -1)
+    {
+        unsigned int end = index + result.length();
+        if ((index == 0 || data[index-1] == '\n') && end < data.length() && data[end] == '\r') return true;
+        index = data.indexOf(result, index + 1);
+    }
+    return false;
+}
+
+void Sim800L::_setLastError(const String &data)
+{
+    _lastErrorCode = 0;
+
+    int index = data.indexOf(F("+CME ERROR:"));
+    _lastError = errorEquipment;
+    if (index == -1)
+    {
+        index = data.indexOf(F("+CMS ERROR:"));
+        _lastError = errorMessage;
+    }
+
+    if (index != -1) _lastErrorCode = data.substring(index + 11).toInt();
+    else if (data.length() == 0) _lastError = errorTimeout;
+    else if (_isError(data)) _lastError = errorGeneric;
+    else _lastError = errorNone;
+}
+
+void Sim800L::_setRxReady(bool ready)
+{
+    if (_rtsPin == FLOW_CONTROL_NONE) return;
+    digitalWrite(_rtsPin, ready ? LOW : HIGH);
+}
+
+void Sim800L::_checkOverflow()
+{
+    _lastReadOverflowed = this->SoftwareSerial::overflow();
+    if (_lastReadOverflowed) _rxOverflowCount++;
+}
+
+// One turn of a blocking wait started at start
+void Sim800L::_idle(uint32_t start)
+{
+    if (onIdle != NULL) onIdle(millis() - start);
+    _sleep();
+}
+
+/*
+ * Idle sleep: the CPU stops until the next interrupt, the RX pin change of
+ * the module or the millis() tick, so every wait and timeout keeps running.
+ */
+void Sim800L::_sleep()
+{
+#if defined(__AVR__)
+    if (!_idleSleep) return;
+    set_sleep_mode(SLEEP_MODE_IDLE);
+    sleep_mode();
+#endif
+}
+
+void Sim800L::_delay(uint32_t ms)
+{
+    uint32_t start = millis();
+    while (millis() - start < ms) _idle(start);
+}
+
+String Sim800L::_readSerial()
+{
+    return _readSerial(TIME_OUT_READ_SERIAL);
+}
+
+/*
+ * Read the answer of a command of the given type, waiting for the
+ * timeout learned from its previous answers. The latency is sampled from
+ * the arrival of the final OK, errors are not sampled.
+ */
+String Sim800L::_readSerial(CommandType type)
+{
+    // The clock starts once the command of a task is answered
+    _waitTaskCommand();
+    uint32_t timeOld = millis();
+    String str = _readSerial(getCommandTimeout(type));
+
+    if (str.length() == 0) _latencyTimeout(type);
+    else if (_okSeen) _updateLatency(type, _okTime - timeOld);
 
+    return str;
 }
 
+/*
+ * Wait up to timeout for the answer, then keep draining until the line
+ * stays silent for _idleGap ms. Long answers (AT+COPS=?, AT+CMGL...) are
+ * consumed while they arrive instead of overflowing the RX buffer.
+ */
 String Sim800L::_readSerial(uint32_t timeout)
 {
 
-    uint64_t timeOld = millis();
+    _waitTaskCommand();
+    uint32_t timeOld = millis();
+
+    _setRxReady(true);
 
-    while (!this->SoftwareSerial::available() && !(millis() > timeOld + timeout))
+    while (!this->SoftwareSerial::available() && (millis() - timeOld < timeout))
     {
-        //delay(13);
+        _idle(timeOld);
     }
 
     String str;
+    uint32_t lastByte = millis();
+    unsigned int lineStart = 0;
+    _okSeen = false;
 
-    while(this->SoftwareSerial::available())
+    while (millis() - lastByte < _idleGap)
     {
-        if (this->SoftwareSerial::available()>0)
+        if (this->SoftwareSerial::available() > 0)
         {
-            str += (char) this->SoftwareSerial::read();
+            char c = (char) read();
+            str += c;
+            lastByte = millis();
+
+            // Time of the final OK, not of the echo or of a late URC
+            if (c == (_compactMode ? '\r' : '\n'))
+            {
+                if (!_okSeen && _hasResult(str.substring(lineStart), _compactMode ? F("0") : F("OK")))
+                {
+                    _okSeen = true;
+                    _okTime = lastByte;
+                }
+                lineStart = str.length();
+            }
+
+            // A numeric final result is the last thing the module sends,
+            // no need to wait for the silence
+            if (_compactMode && c == '\r' && str.length() >= 2)
+            {
+                char code = str[str.length()-2];
+                if ((code == '0' || code == '4') && (str.length() == 2 || str[str.length()-3] == '\n')) break;
+            }
         }
+        // Only the sleep: onIdle could outlast the silence that ends the answer
+        else _sleep();
     }
 
+    _setRxReady(false);
+    _checkOverflow();
+
+    _dispatchUrcs(str);
+    _setLastError(str);
     return str;
 
 }
-
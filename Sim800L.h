@@ -48,6 +48,64 @@
 #define Sim800L_h
 #include <SoftwareSerial.h>
 #include "Arduino.h"
+#include "Sim800LTask.h"
+
+/*
+ * FEATURES
+ * Set a feature to 0, here or with a compiler flag (-DSIM800L_ENABLE_CALL=0),
+ * to leave its methods, command strings and member variables out of the
+ * sketch. extras/footprint/footprint.sh reports the size of each configuration.
+ */
+#ifndef SIM800L_ENABLE_CALL
+#define SIM800L_ENABLE_CALL			1		// calls and call events
+#endif
+#ifndef SIM800L_ENABLE_SMS
+#define SIM800L_ENABLE_SMS			1		// send, receive and store sms
+#endif
+#ifndef SIM800L_ENABLE_LOCATION
+#define SIM800L_ENABLE_LOCATION		1		// GSM location (AT+CIPGSMLOC)
+#endif
+#ifndef SIM800L_ENABLE_RTC
+#define SIM800L_ENABLE_RTC			1		// module clock and network time
+#endif
+#ifndef SIM800L_ENABLE_PIN
+#define SIM800L_ENABLE_PIN			1		// SIM PIN handling
+#endif
+#ifndef SIM800L_ENABLE_OPERATOR
+#define SIM800L_ENABLE_OPERATOR		1		// operator list and name
+#endif
+#ifndef SIM800L_ENABLE_RECORDER
+#define SIM800L_ENABLE_RECORDER		1		// traffic recording
+#endif
+#ifndef SIM800L_ENABLE_CELL
+#define SIM800L_ENABLE_CELL			1		// serving and neighbour cells (AT+CENG)
+#endif
+#ifndef SIM800L_ENABLE_WATCHDOG
+#define SIM800L_ENABLE_WATCHDOG		1		// health supervision and recovery
+#endif
+#ifndef SIM800L_ENABLE_FTP
+#define SIM800L_ENABLE_FTP			1		// FTP download and upload
+#endif
+#ifndef SIM800L_ENABLE_SIGNAL_LOG
+#define SIM800L_ENABLE_SIGNAL_LOG	1		// signal quality history
+#endif
+#ifndef SIM800L_ENABLE_DTMF
+#define SIM800L_ENABLE_DTMF			1		// DTMF keys and keypad menus, needs CALL
+#endif
+#ifndef SIM800L_ENABLE_USSD
+#define SIM800L_ENABLE_USSD			1		// USSD requests (AT+CUSD)
+#endif
+#if !SIM800L_ENABLE_CALL
+#undef SIM800L_ENABLE_DTMF
+#define SIM800L_ENABLE_DTMF			0
+#endif
+
+#if SIM800L_ENABLE_RECORDER
+#include "Sim800LRecorder.h"
+#endif
+#if SIM800L_ENABLE_SIGNAL_LOG
+#include "Sim800LSignalLog.h"
+#endif
 
 
 #define DEFAULT_RX_PIN 		10
@@ -60,6 +118,89 @@
 #define BUFFER_RESERVE_MEMORY	300
 #define DEFAULT_BAUD_RATE		9600
 #define TIME_OUT_READ_SERIAL	5000
+#define FLOW_CONTROL_NONE		255		// RTS/CTS pins not wired
+#define CTS_TIME_OUT			1000	// ms to wait for CTS before sending anyway
+#define URC_LINE_MAX_LENGTH		64		// longest unsolicited line kept by poll()
+#define COMMAND_RESPONSE_RESERVE	64		// answer of the command sent by a task
+#define RESET_RETRIES			10		// AT probes after a reset before giving up
+#define ADAPTIVE_MIN_SAMPLES	4		// answers seen before a timeout is learned
+#define ADAPTIVE_MARGIN			200		// ms added to the learned timeouts
+#define DELIVERY_TABLE_SIZE		8		// sms waiting for their status report
+#define DELIVERY_TIME_OUT		3600000	// ms before a missing status report is given up
+#define DELIVERY_FREE			-1
+#define DELIVERY_STATUS_TIME_OUT	0xFF	// reported when no status report arrived
+#define CELL_NEIGHBOURS			6		// neighbour cells reported by AT+CENG
+#define BOOT_TIME_OUT			30000	// ms for SMS Ready after a reset
+#define WATCHDOG_TIME_OUTS		3		// consecutive time outs before a recovery
+#define SMS_MODE_UNSET			255
+#define DTMF_MENU_START			0		// menu state when a call is connected
+#define DTMF_KEY_ANY			0		// menu key matching any key
+#define DTMF_KEY_TIME_OUT		'T'		// menu key matching the timeout
+#ifndef USSD_LINE_MAX_LENGTH
+#define USSD_LINE_MAX_LENGTH	200		// longest +CUSD line kept by poll()
+#endif
+#define USSD_TIME_OUT			30000	// ms for the network answer
+#ifndef SMS_LINE_MAX_LENGTH
+#define SMS_LINE_MAX_LENGTH		360		// longest +CMT message kept by poll(), a PDU is 352 hex digits
+#endif
+#define SMS_NUMBER_SIZE			22		// sender of a +CMT in text mode, with the '\0'
+#define SMS_TIME_SIZE			21		// "yy/MM/dd,hh:mm:ss+zz" and the '\0'
+#ifndef FTP_CHUNK_SIZE
+#define FTP_CHUNK_SIZE			64		// bytes per AT+FTPGET=2 / AT+FTPPUT=2, on the stack
+#endif
+#define FTP_TIME_OUT			75000	// ms to open the FTP session
+#define FTP_DATA_TIME_OUT		10000	// ms for a chunk
+#define FTP_STATUS_NONE			-1
+
+enum CommandStatus {
+    commandIdle = 0,
+    commandPending = 1,         // sent, waiting for the final result
+    commandOk = 2,
+    commandError = 3,           // ERROR, +CME ERROR or +CMS ERROR
+    commandTimeout = 4,
+} ;
+
+// Kind of failure of the last command, see getLastErrorCode() for the code
+enum ModemError {
+    errorNone = 0,
+    errorTimeout = 1,           // no answer before the timeout
+    errorGeneric = 2,           // bare ERROR, no code available
+    errorEquipment = 3,         // +CME ERROR: <code>
+    errorMessage = 4,           // +CMS ERROR: <code>
+    errorFtp = 5,               // +FTPGET: 1,<code> or +FTPPUT: 1,<code>
+} ;
+
+// Codes worth a retry, the others will fail again
+#define CME_SIM_BUSY			14
+#define CME_NO_NETWORK			30
+#define CME_NETWORK_TIME_OUT	31
+#define CMS_SIM_BUSY			314
+#define CMS_NO_NETWORK			331
+#define CMS_NETWORK_TIME_OUT	332
+
+enum CommandType {
+    commandGeneric = 0,         // quick queries, AT, AT+CSQ, AT+CREG?...
+    commandPin = 1,             // AT+CPIN, AT+CLCK
+    commandSmsSend = 2,         // AT+CMGS
+    commandSmsDelete = 3,       // AT+CMGD
+    commandNetworkScan = 4,     // AT+COPS=?
+    commandNetworkSelect = 5,   // AT+COPS=1
+    commandLocation = 6,        // AT+CIPGSMLOC
+    commandBearer = 7,          // AT+SAPBR=1 and AT+SAPBR=0
+    commandTypeCount = 8,
+} ;
+
+enum TaskId {
+    taskReset = 0,
+    taskBearer = 1,
+    taskDisablePin = 2,
+    taskUpdateRtc = 3,
+    taskCellMonitor = 4,
+    taskWatchdog = 5,
+    taskSignalLog = 6,
+    taskUssd = 7,
+    taskCount = 8,
+} ;
 
 enum NetworkRegistrationStatus  {
     notRegistrerAndNotSearching = 0,
@@ -75,6 +216,99 @@ enum NetworkRegistrationStatus  {
     registeredForCSFBNotPreferedRoaming = 10,
 } ;
 
+#if SIM800L_ENABLE_OPERATOR
+enum OperatorStatus {
+    operatorUnknown = 0,
+    operatorAvailable = 1,
+    operatorCurrent = 2,
+    operatorForbidden = 3,
+} ;
+
+struct OperatorInfo {
+    OperatorStatus status;
+    char longName[17];          // "vodafone IT"
+    char shortName[9];          // "voda IT"
+    char numeric[7];            // "22210", MCC and MNC
+} ;
+#endif
+
+#if SIM800L_ENABLE_CELL
+struct CellInfo {
+    uint16_t arfcn;             // absolute radio frequency channel number
+    uint8_t rxLevel;            // 0 (-110 dBm or less) .. 63 (-48 dBm or more)
+    uint8_t bsic;               // base station identity code
+    uint16_t cellId;
+    uint16_t lac;               // location area code
+} ;
+#endif
+
+#if SIM800L_ENABLE_SMS
+enum SmsDelivery {
+    smsDeliverNone = 0,         // stored on the SIM, not reported
+    smsDeliverStore = 1,        // stored on the SIM, +CMTI with the index
+    smsDeliverDirect = 2,       // not stored, +CMT with the message
+} ;
+
+struct SmsHeader {
+    const char *number;         // sender, text mode only ("" in PDU mode)
+    const char *timestamp;      // "yy/MM/dd,hh:mm:ss+zz" of the service centre, text mode only
+    uint16_t pduLength;         // octets of the TPDU, PDU mode only
+    bool pdu;                   // the message is the hex PDU
+} ;
+
+enum SmsDeleteFlag {
+    smsDeleteRead = 1,                  // read messages
+    smsDeleteReadAndSent = 2,           // read and sent messages
+    smsDeleteReadSentAndUnsent = 3,     // read, sent and unsent messages
+} ;
+
+struct SmsDeliveryReport {
+    uint8_t reference;          // TP-MR returned by sendSms(pdu)
+    uint8_t status;             // TP-ST: 0x00 delivered, 0x40..0x7F failed, DELIVERY_STATUS_TIME_OUT
+    uint32_t latency;           // ms from the submission to the report
+    const char *dischargeTime;  // TP-DT "yy/MM/dd,hh:mm:ss", empty on time out
+} ;
+#endif
+
+#if SIM800L_ENABLE_CALL
+enum CallState {
+    callIdle = 0,           // no call
+    callIncoming = 1,       // RING received, not answered yet
+    callDialing = 2,        // ATD sent, waiting for the remote party
+    callActive = 3,         // voice call connected
+} ;
+
+enum CallResult {
+    callAnswered = 0,       // +COLP received, remote party answered
+    callBusy = 1,           // BUSY
+    callNoAnswer = 2,       // NO ANSWER
+    callNoCarrier = 3,      // NO CARRIER before the call was connected
+} ;
+#endif
+
+#if SIM800L_ENABLE_USSD
+enum UssdStatus {
+    ussdDone = 0,               // answer, no further action
+    ussdReplyNeeded = 1,        // answer to a menu, reply with sendUssd()
+    ussdTerminated = 2,         // session ended by the network
+    ussdOtherClient = 3,        // answered by another local client
+    ussdNotSupported = 4,       // operation not supported
+    ussdNetworkTimeout = 5,     // network time out
+    ussdError = 6,              // AT+CUSD refused
+    ussdTimeout = 7,            // no answer within USSD_TIME_OUT
+    ussdPending = 8,            // waiting for the answer
+} ;
+#endif
+
+#if SIM800L_ENABLE_DTMF
+struct DtmfMenuEntry {
+    uint8_t state;              // state the entry applies to
+    char key;                   // '0'..'9', '*', '#', 'A'..'D', DTMF_KEY_ANY or DTMF_KEY_TIME_OUT
+    uint8_t next;               // state after the key
+    uint8_t action;             // passed to onDtmfMenu, 0 for none
+} ;
+#endif
+
 class Sim800L : public SoftwareSerial
 {
 private:
@@ -84,12 +318,192 @@ private:
     String _buffer;
     bool _sleepMode;
     uint8_t _functionalityMode;
+#if SIM800L_ENABLE_LOCATION
     String _locationCode;
     String _longitude;
     String _latitude;
+#endif
+    String _urcLine;
+    String _commandResponse;
+    Sim800LTask *_commandOwner;
+    CommandStatus _commandStatus;
+    bool _polling;
+    uint32_t _commandStart;
+    uint32_t _commandTimeout;
+    CommandType _commandType;
+    bool _adaptiveTimeouts = true;
+    uint16_t _latency[commandTypeCount];
+    uint16_t _latencyDeviation[commandTypeCount];
+    uint8_t _latencySamples[commandTypeCount];
+    uint32_t _okTime;
+    bool _okSeen;
+    Sim800LTask _tasks[taskCount];
+    Sim800LTask _childTask;
+    String _taskText;
+    int _taskUtc;
+    bool _smsReady;
+    uint8_t _timeOuts;
+    bool _bearerActive;
+#if SIM800L_ENABLE_WATCHDOG
+    Sim800LTask _recoveryTask;
+    uint32_t _watchdogInterval;
+    bool _powerDown;
+    bool _recovering;
+    uint16_t _recoveries;
+#endif
+#if SIM800L_ENABLE_PIN
+    String _savedPin;
+#endif
+#if SIM800L_ENABLE_FTP
+    int16_t _ftpStatus;
+    uint16_t _ftpMaxLength;
+#endif
+#if SIM800L_ENABLE_CALL
+    String _callerNumber;
+    CallState _callState;
+    bool _callerIdEnabled;
+#endif
+#if SIM800L_ENABLE_USSD
+    String _ussdText;
+    UssdStatus _ussdStatus;
+    bool _ussdCancel;
+#endif
+#if SIM800L_ENABLE_DTMF
+    bool _dtmfEnabled;
+    const DtmfMenuEntry *_dtmfMenu;
+    uint8_t _dtmfMenuCount;
+    uint8_t _dtmfState;
+    uint32_t _dtmfTimeout;
+    uint32_t _dtmfTime;
+#endif
+#if SIM800L_ENABLE_RECORDER
+    Sim800LRecorder *_recorder = NULL;
+#endif
+#if SIM800L_ENABLE_SIGNAL_LOG
+    Sim800LSignalLog *_signalLog;
+    uint32_t _signalLogInterval;
+    uint8_t _signalRssi;
+    uint8_t _signalBer;
+#endif
+    uint8_t _rtsPin = FLOW_CONTROL_NONE;
+    uint8_t _ctsPin = FLOW_CONTROL_NONE;
+    uint32_t _idleGap;
+    uint16_t _rxOverflowCount;
+    bool _lastReadOverflowed;
+    bool _compactMode;
+    bool _idleSleep;
+    ModemError _lastError;
+    uint16_t _lastErrorCode;
+#if SIM800L_ENABLE_OPERATOR
+    void (*_operatorCallback)(const OperatorInfo &info);
+    const char *const *_operatorAllowed;
+    uint8_t _operatorAllowedCount;
+    OperatorInfo _bestOperator;
+#endif
+#if SIM800L_ENABLE_CELL
+    CellInfo _servingCell;
+    CellInfo _neighbourCells[CELL_NEIGHBOURS];
+    uint8_t _neighbourCount;
+    uint32_t _cellSampleTime;
+    uint32_t _cellInterval;
+#endif
+#if SIM800L_ENABLE_SMS
+    uint16_t _smsUsed;
+    uint16_t _smsTotal;
+    bool _deleteAfterRead;
+    bool _smsAutoCleanup;
+    uint8_t _savedSmsMode;
+    uint8_t _smsDelivery;
+    bool _smsBodyPending;
+    bool _statusReportPending;
+    bool _smsUrcsParsed;
+    SmsHeader _smsHeader;
+    char _smsNumber[SMS_NUMBER_SIZE];
+    char _smsTime[SMS_TIME_SIZE];
+    struct {
+        int16_t reference;
+        uint32_t submitted;
+    } _deliveries[DELIVERY_TABLE_SIZE];
+    uint32_t _deliveryTimeout;
+#endif
 
     String _readSerial();
     String _readSerial(uint32_t timeout);
+    String _readSerial(CommandType type);
+    void _updateLatency(CommandType type, uint32_t sample);
+    void _latencyTimeout(CommandType type);
+    bool _handleUrc(const String &line);
+    void _handleLine(const String &line);
+    bool _taskCommand(Sim800LTask &task, const __FlashStringHelper *command, CommandType type);
+    bool _taskCommand(Sim800LTask &task, const String &command, CommandType type);
+    void _waitTaskCommand();
+    bool _startTask(TaskId id);
+    void _runTasks();
+    bool _runTask(TaskId id);
+    bool _resetTask(Sim800LTask &task);
+    bool _bearerTask(Sim800LTask &task);
+#if SIM800L_ENABLE_PIN
+    bool _disablePinTask(Sim800LTask &task);
+#endif
+#if SIM800L_ENABLE_CELL
+    bool _cellTask(Sim800LTask &task);
+    void _parseCellInfo(const String &data);
+#endif
+#if SIM800L_ENABLE_WATCHDOG
+    bool _watchdogTask(Sim800LTask &task);
+#endif
+#if SIM800L_ENABLE_SIGNAL_LOG
+    bool _signalLogTask(Sim800LTask &task);
+#endif
+#if SIM800L_ENABLE_RTC
+    bool _updateRtcTask(Sim800LTask &task);
+    String _rtcCommand(String date, int utc);
+#endif
+    void _dispatchUrcs(const String &data);
+    bool _isOk(const String &data);
+    bool _isError(const String &data);
+    bool _hasResult(const String &data, const String &result);
+    void _setLastError(const String &data);
+#if SIM800L_ENABLE_OPERATOR
+    bool _scanOperators();
+    void _onOperator(const OperatorInfo &info);
+#endif
+#if SIM800L_ENABLE_SMS
+    void _trackSubmit(int reference);
+    void _trackStatusReport(const String &pdu);
+    void _reportDelivery(uint8_t slot, uint8_t status, const char *dischargeTime);
+    void _printUcs2(const char *text);
+    bool _handleSmsUrc(const String &line);
+    void _parseSmsHeader(const String &data, int start);
+#endif
+#if SIM800L_ENABLE_CALL
+    bool _handleCallUrc(const String &line);
+    void _setCallState(CallState state);
+#endif
+#if SIM800L_ENABLE_DTMF
+    void _dtmfKey(char key);
+#endif
+#if SIM800L_ENABLE_USSD
+    bool _ussdTask(Sim800LTask &task);
+    void _handleUssd(const String &line);
+    void _ussdEnd(UssdStatus status);
+    bool _quoteOpen(const String &line);
+#endif
+#if SIM800L_ENABLE_FTP
+    long _ftpGet(const char *path, const char *name, uint32_t offset, bool (*onData)(const uint8_t *data, uint16_t length), Print *out);
+    long _ftpPut(const char *path, const char *name, bool append, uint16_t (*onData)(uint8_t *data, uint16_t size), Stream *in);
+    bool _ftpCommand(const __FlashStringHelper *command, const char *argument);
+    bool _ftpResult(uint32_t timeout);
+    bool _ftpWaitStatus(uint32_t timeout);
+    String _ftpLine(uint32_t timeout);
+    String _readLine(uint32_t timeout);
+    uint16_t _readBytes(uint8_t *buffer, uint16_t length, uint32_t timeout);
+#endif
+    void _setRxReady(bool ready);
+    void _checkOverflow();
+    void _idle(uint32_t start);
+    void _sleep();
+    void _delay(uint32_t ms);
 
 public:
 
@@ -100,8 +514,35 @@ public:
     uint8_t LED_PIN;
     bool	LED_FLAG;
 
+#if SIM800L_ENABLE_SMS
     void (*onStatusReport)(String);
     void (*onNewMessage)(String);
+    void (*onSms)(const SmsHeader &header, const char *text, uint16_t length) = NULL;
+    void (*onSmsStored)(uint8_t index) = NULL;
+    void (*onDeliveryReport)(const SmsDeliveryReport &report) = NULL;
+    void (*onBroadcastResult)(uint8_t index, int reference) = NULL;
+#endif
+#if SIM800L_ENABLE_CALL
+    void (*onIncomingCall)(String number) = NULL;
+    void (*onCallConnected)(void) = NULL;
+    void (*onCallEnded)(void) = NULL;
+    void (*onCallResult)(CallResult result) = NULL;
+#endif
+#if SIM800L_ENABLE_DTMF
+    void (*onDtmf)(char key) = NULL;
+    void (*onDtmfMenu)(uint8_t action, char key) = NULL;
+#endif
+#if SIM800L_ENABLE_USSD
+    void (*onUssd)(UssdStatus status, const String &text) = NULL;
+#endif
+#if SIM800L_ENABLE_CELL
+    void (*onCellInfo)(const CellInfo &serving, const CellInfo *neighbours, uint8_t count) = NULL;
+#endif
+#if SIM800L_ENABLE_WATCHDOG
+    void (*onRecovery)(bool hardReset, bool success) = NULL;
+#endif
+    void (*onTaskDone)(TaskId id, bool success) = NULL;
+    void (*onIdle)(uint32_t elapsed) = NULL;
     Sim800L(void);
     Sim800L(uint8_t rx, uint8_t tx);
     Sim800L(uint8_t rx, uint8_t tx, uint8_t rst);
@@ -115,48 +556,149 @@ public:
     bool getSleepMode();
     bool setFunctionalityMode(uint8_t fun);
     uint8_t getFunctionalityMode();
+    bool setCompactMode(bool state);
+    bool getCompactMode();
+    bool setErrorCodes(bool state);
+    ModemError getLastError();
+    uint16_t getLastErrorCode();
+    bool isErrorTransient();
 
+#if SIM800L_ENABLE_PIN
     bool PINIsReady();
     bool setPIN(String pin);
     bool disablePin(String pin);
+#endif
     String getProductInfo();
 
+#if SIM800L_ENABLE_OPERATOR
     String getOperatorsList();
+    bool getOperatorsList(void (*callback)(const OperatorInfo &info));
+    bool selectBestOperator(const char *const *allowed = NULL, uint8_t count = 0);
     String getOperator();
+#endif
     bool registerToNetwork();
     NetworkRegistrationStatus registrationStatus();
 
+#if SIM800L_ENABLE_LOCATION
     bool calculateLocation();
     String getLocationCode();
     String getLongitude();
     String getLatitude();
+#endif
 
+#if SIM800L_ENABLE_CALL
     bool answerCall();
     void callNumber(char* number);
     bool hangoffCall();
     uint8_t getCallStatus();
+    bool prepareForCallEvents();
+    CallState getCallState();
+    String getCallerNumber();
+#endif
+#if SIM800L_ENABLE_DTMF
+    bool setDtmfDetection(bool state);
+    void setDtmfMenu(const DtmfMenuEntry *menu, uint8_t count, uint32_t timeout);
+    uint8_t getDtmfState();
+#endif
+    bool poll();
 
+    bool resetAsync();
+    bool activateBearerProfileAsync();
+#if SIM800L_ENABLE_PIN
+    bool disablePinAsync(String pin);
+#endif
+#if SIM800L_ENABLE_RTC
+    bool updateRtcAsync(int utc);
+#endif
+    bool isTaskRunning(TaskId id);
+
+#if SIM800L_ENABLE_WATCHDOG
+    bool setWatchdog(uint32_t interval);
+    uint16_t getRecoveries();
+#endif
+
+    void setAdaptiveTimeouts(bool state);
+    uint32_t getCommandTimeout(CommandType type);
+
+    bool setFlowControl(uint8_t rts, uint8_t cts);
+    bool setIdleSleep(bool state);
+    uint16_t getRxOverflowCount();
+    bool lastReadOverflowed();
+
+#if SIM800L_ENABLE_RECORDER
+    void setRecorder(Sim800LRecorder *recorder);
+#endif
+    size_t write(uint8_t c);
+    size_t write(const uint8_t *buffer, size_t size);
+    using Print::write;
+    int read();
+
+#if SIM800L_ENABLE_SMS
 	const uint8_t checkForSMS();
 	bool prepareForSmsReceive();
+    bool setSmsDelivery(SmsDelivery delivery);
 	bool setPduMode();
 	bool setTextMode();
     int sendSms(String pdu);
     bool sendSms(char* number,char* text);
+    bool sendSmsUnicode(const char *number, const char *text);
+    uint8_t broadcastSms(const char *const *numbers, uint8_t count, const char *text);
     void checkForGsmMessage();
     String readSms(uint8_t index);
     String getNumberSms(uint8_t index);
     bool delAllSms();
+    bool delSms(uint8_t index);
+    bool delSmsByStatus(SmsDeleteFlag flag);
+    bool getSmsStorage(uint16_t *used, uint16_t *total);
+    bool setSmsStorage(String storage);
+    bool isSmsStorageFull();
+    void setDeleteAfterRead(bool state);
+    void setSmsAutoCleanup(bool state);
+    void setDeliveryTimeout(uint32_t timeout);
+    uint8_t getPendingDeliveries();
+    void checkDeliveryTimeouts();
+#endif
+#if SIM800L_ENABLE_SMS || SIM800L_ENABLE_USSD
+    bool decodeUcs2(String &text);
+#endif
+#if SIM800L_ENABLE_USSD
+    bool sendUssd(const char *code);
+    bool cancelUssd();
+    UssdStatus getUssdStatus();
+    const String &getUssdText();
+#endif
 
 
     String signalQuality();
+#if SIM800L_ENABLE_CELL
+    bool readCellInfo();
+    bool setCellMonitoring(uint32_t interval);
+    const CellInfo &getServingCell();
+    uint8_t getNeighbourCount();
+    const CellInfo &getNeighbourCell(uint8_t index);
+    uint32_t getCellSampleTime();
+#endif
+#if SIM800L_ENABLE_SIGNAL_LOG
+    bool setSignalLog(Sim800LSignalLog *log, uint32_t interval);
+#endif
     void setPhoneFunctionality();
     void activateBearerProfile();
     void deactivateBearerProfile();
     bool setMode();
 
+#if SIM800L_ENABLE_FTP
+    bool ftpBegin(const char *server, const char *user, const char *password, uint16_t port = 21);
+    long ftpGet(const char *path, const char *name, bool (*onData)(const uint8_t *data, uint16_t length), uint32_t offset = 0);
+    long ftpGet(const char *path, const char *name, Print &out, uint32_t offset = 0);
+    long ftpPut(const char *path, const char *name, uint16_t (*onData)(uint8_t *data, uint16_t size), bool append = false);
+    long ftpPut(const char *path, const char *name, Stream &in, bool append = false);
+#endif
+
+#if SIM800L_ENABLE_RTC
     void RTCtime(int *day,int *month, int *year,int *hour,int *minute, int *second);
     String dateNet();
     bool updateRtc(int utc);
+#endif
 
 };
 
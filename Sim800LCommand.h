@@ -0,0 +1,52 @@
+/*
+ *  Sim800LCommand
+ *
+ *  A command line assembled on the stack with the usual print() calls and
+ *  handed to the module with a single write(), instead of one write per
+ *  fragment (prefix, number, argument, terminator).
+ *
+ *  USAGE
+ *		Sim800LCommand command(*this);
+ *		command.print(F("ATD"));
+ *		command.print(number);
+ *		command.print(F(";\r\n"));
+ *		command.send();
+ *
+ *  A line longer than COMMAND_BUFFER_SIZE goes out in several writes.
+ *
+*/
+
+#ifndef Sim800LCommand_h
+#define Sim800LCommand_h
+#include "Arduino.h"
+
+#define COMMAND_BUFFER_SIZE		48		// longest command sent in one write
+
+class Sim800LCommand : public Print
+{
+private:
+
+    Print &_out;
+    uint8_t _buffer[COMMAND_BUFFER_SIZE];
+    uint8_t _length;
+
+public:
+
+    Sim800LCommand(Print &out) : _out(out), _length(0) {}
+
+    size_t write(uint8_t c)
+    {
+        if (_length == COMMAND_BUFFER_SIZE) send();
+        _buffer[_length++] = c;
+        return 1;
+    }
+    using Print::write;
+
+    void send()
+    {
+        if (_length > 0) _out.write(_buffer, _length);
+        _length = 0;
+    }
+} ;
+
+#endif
@@ -0,0 +1,190 @@
+/*
+ *  Sim800LManager
+ *
+ *  Drives several Sim800L modules from one MCU, see Sim800LManager.h
+ *
+*/
+
+#include "Arduino.h"
+#include "Sim800LManager.h"
+
+Sim800LManager *Sim800LManager::_instance = NULL;
+uint8_t Sim800LManager::_active = 0;
+
+Sim800LManager::Sim800LManager(void)
+{
+    _count 			= 0;
+    _listening 		= 0;
+    _nextSms 		= 0;
+    _listenSince 	= 0;
+
+#if SIM800L_ENABLE_SMS
+    onNewMessage 	= NULL;
+    onStatusReport 	= NULL;
+#endif
+#if SIM800L_ENABLE_CALL
+    onIncomingCall 	= NULL;
+    onCallEnded 	= NULL;
+    onCallResult 	= NULL;
+#endif
+
+    _instance = this;
+}
+
+/*
+ * Register a module, begin() must already have been called on it.
+ * Return the index of the module, -1 if the manager is full.
+ */
+int8_t Sim800LManager::add(Sim800L &modem)
+{
+    if (_count >= MANAGER_MAX_MODEMS) return -1;
+
+    _modems[_count] 	= &modem;
+    _smsSent[_count] 	= 0;
+    _failures[_count] 	= 0;
+
+#if SIM800L_ENABLE_SMS
+    modem.onNewMessage 		= _onNewMessage;
+    modem.onStatusReport 	= _onStatusReport;
+#endif
+#if SIM800L_ENABLE_CALL
+    modem.onIncomingCall 	= _onIncomingCall;
+    modem.onCallEnded 		= _onCallEnded;
+    modem.onCallResult 		= _onCallResult;
+#endif
+
+    return _count++;
+}
+
+uint8_t Sim800LManager::count()
+{
+    return _count;
+}
+
+/*
+ * Make the module the one receiving, must be used before sending it
+ * any command, otherwise its answer is lost. An index out of range
+ * returns the active module.
+ */
+Sim800L &Sim800LManager::select(uint8_t index)
+{
+    if (index >= _count) index = _active;
+    _active = index;
+
+    if (_listening != index || !_modems[index]->isListening())
+    {
+        _modems[index]->listen();
+        _listening = index;
+        _listenSince = millis();
+    }
+
+    return *_modems[index];
+}
+
+/*
+ * Non blocking, call it from loop(). Events of the listening module are
+ * dispatched, after MANAGER_LISTEN_WINDOW ms the next module gets the port.
+ */
+void Sim800LManager::poll()
+{
+    if (_count == 0) return;
+
+    if (_count > 1 && millis() - _listenSince >= MANAGER_LISTEN_WINDOW)
+    {
+        // Do not switch in the middle of a line, it would be lost
+        if (_modems[_listening]->available() == 0)
+        {
+            select((_listening + 1) % _count);
+        }
+    }
+
+    select(_listening).poll();
+}
+
+#if SIM800L_ENABLE_SMS
+/*
+ * Send the sms with the module that has sent less messages so far,
+ * skipping the ones in the middle of a send (isBusy), on failure the next
+ * module is tried.
+ * Return the index of the module that sent it, -1 if every module failed.
+ */
+int8_t Sim800LManager::sendSms(const char* number, const char* text)
+{
+    for (uint8_t attempt = 0; attempt < _count; attempt++)
+    {
+        int8_t chosen = -1;
+
+        for (uint8_t i = 0; i < _count; i++)
+        {
+            uint8_t index = (_nextSms + i) % _count;
+
+            if (_modems[index]->isBusy || _failures[index] >= MANAGER_MAX_FAILURES) continue;
+            if (chosen == -1 || _smsSent[index] < _smsSent[chosen]) chosen = index;
+        }
+
+        if (chosen == -1) return -1;
+
+        _nextSms = (chosen + 1) % _count;
+
+        // sendSms returns true on error, it does not change number and text
+        if (!select(chosen).sendSms(const_cast<char *>(number), const_cast<char *>(text)))
+        {
+            _smsSent[chosen]++;
+            _failures[chosen] = 0;
+            return chosen;
+        }
+
+        _failures[chosen]++;
+    }
+
+    return -1;
+}
+
+uint16_t Sim800LManager::getSmsSent(uint8_t index)
+{
+    return _smsSent[index];
+}
+
+/*
+ * A module is skipped by sendSms after MANAGER_MAX_FAILURES consecutive
+ * failures, call this once it is known to work again.
+ */
+void Sim800LManager::resetFailures(uint8_t index)
+{
+    _failures[index] = 0;
+}
+#endif
+
+
+//
+//PRIVATE METHODS
+//
+#if SIM800L_ENABLE_SMS
+void Sim800LManager::_onNewMessage(String message)
+{
+    if (_instance->onNewMessage != NULL) _instance->onNewMessage(_active, message);
+}
+
+void Sim800LManager::_onStatusReport(String report)
+{
+    if (_instance->onStatusReport != NULL) _instance->onStatusReport(_active, report);
+}
+
+#endif
+
+#if SIM800L_ENABLE_CALL
+void Sim800LManager::_onIncomingCall(String number)
+{
+    if (_instance->onIncomingCall != NULL) _instance->onIncomingCall(_active, number);
+}
+
+void Sim800LManager::_onCallEnded(void)
+{
+    if (_instance->onCallEnded != NULL) _instance->onCallEnded(_active);
+}
+
+void Sim800LManager::_onCallResult(CallResult result)
+{
+    if (_instance->onCallResult != NULL) _instance->onCallResult(_active, result);
+}
+#endif
@@ -0,0 +1,80 @@
+/*
+ *  Sim800LManager
+ *
+ *  Drives several Sim800L modules from one MCU.
+ *
+ *  Every Sim800L is a SoftwareSerial, so only one module at a time can
+ *  receive. The manager gives each module a listen window in turn, selects
+ *  the right one before every command and spreads outgoing SMS over the
+ *  modules that are not busy. Events of all the modules are reported through
+ *  a single set of callbacks carrying the index of the module.
+ *
+ *  NOTE: bytes sent by a module while another one is listening are lost,
+ *  prefer AT+CNMI=2,1 (store and notify) so incoming SMS stay on the SIM.
+ *  Only one manager per sketch: the callbacks of the modules lead to the
+ *  last Sim800LManager created.
+ *
+*/
+
+#ifndef Sim800LManager_h
+#define Sim800LManager_h
+#include "Arduino.h"
+#include "Sim800L.h"
+
+#define MANAGER_MAX_MODEMS		4
+#define MANAGER_LISTEN_WINDOW	50		// ms each module listens before the next one
+#define MANAGER_MAX_FAILURES	3		// consecutive SMS failures before a module is skipped
+
+class Sim800LManager
+{
+private:
+
+    Sim800L *_modems[MANAGER_MAX_MODEMS];
+    uint16_t _smsSent[MANAGER_MAX_MODEMS];
+    uint8_t _failures[MANAGER_MAX_MODEMS];
+    uint8_t _count;
+    uint8_t _listening;
+    uint8_t _nextSms;
+    uint32_t _listenSince;
+
+    static Sim800LManager *_instance;
+    static uint8_t _active;
+
+#if SIM800L_ENABLE_SMS
+    static void _onNewMessage(String message);
+    static void _onStatusReport(String report);
+#endif
+#if SIM800L_ENABLE_CALL
+    static void _onIncomingCall(String number);
+    static void _onCallEnded(void);
+    static void _onCallResult(CallResult result);
+#endif
+
+public:
+
+#if SIM800L_ENABLE_SMS
+    void (*onNewMessage)(uint8_t modem, String message);
+    void (*onStatusReport)(uint8_t modem, String report);
+#endif
+#if SIM800L_ENABLE_CALL
+    void (*onIncomingCall)(uint8_t modem, String number);
+    void (*onCallEnded)(uint8_t modem);
+    void (*onCallResult)(uint8_t modem, CallResult result);
+#endif
+
+    Sim800LManager(void);
+
+    int8_t add(Sim800L &modem);
+    uint8_t count();
+    Sim800L &select(uint8_t index);
+
+    void poll();
+#if SIM800L_ENABLE_SMS
+    int8_t sendSms(const char* number, const char* text);
+    uint16_t getSmsSent(uint8_t index);
+    void resetFailures(uint8_t index);
+#endif
+
+};
+
+#endif
@@ -0,0 +1,184 @@
+/*
+ *  Sim800LRecorder
+ *
+ *  Binary log of the Sim800L traffic, see Sim800LRecorder.h
+ *
+*/
+
+#include "Arduino.h"
+#include "Sim800LRecorder.h"
+
+Sim800LRecorder::Sim800LRecorder(void)
+{
+    _out 			= NULL;
+    _ring 			= NULL;
+    _ringSize 		= 0;
+    _chunkLength 	= 0;
+}
+
+/*
+ * Stream every record to out (Serial, an SD File...)
+ */
+void Sim800LRecorder::begin(Print &out)
+{
+    _out 			= &out;
+    _ring 			= NULL;
+    _chunkLength 	= 0;
+    _dropped 		= 0;
+    _lastTime 		= millis();
+
+    _out->print(F("S8RL"));
+    _out->write((uint8_t) RECORDER_VERSION);
+}
+
+/*
+ * Keep the records in ring, when it is full the oldest records are
+ * dropped. Use dump() to get a log.
+ */
+void Sim800LRecorder::begin(uint8_t *ring, uint16_t size)
+{
+    _out 			= NULL;
+    _ring 			= ring;
+    _ringSize 		= size;
+    _head 			= 0;
+    _tail 			= 0;
+    _used 			= 0;
+    _chunkLength 	= 0;
+    _dropped 		= 0;
+    _lastTime 		= millis();
+}
+
+void Sim800LRecorder::end()
+{
+    flush();
+    _out = NULL;
+    _ring = NULL;
+}
+
+void Sim800LRecorder::record(uint8_t direction, uint8_t c)
+{
+    if (_out == NULL && _ring == NULL) return;
+
+    uint32_t now = millis();
+
+    if (_chunkLength > 0 &&
+        (direction != _chunkDirection || _chunkLength == RECORDER_CHUNK_SIZE || now - _chunkTime > RECORDER_GAP))
+    {
+        flush();
+    }
+
+    if (_chunkLength == 0)
+    {
+        _chunkDirection = direction;
+        _chunkTime = now;
+    }
+
+    _chunk[_chunkLength++] = c;
+}
+
+/*
+ * Emit the buffered bytes as a record
+ */
+void Sim800LRecorder::flush()
+{
+    if (_chunkLength == 0) return;
+
+    uint8_t header = (_chunkDirection == RECORDER_TX ? 0x80 : 0x00) | (_chunkLength - 1);
+    uint32_t delta = _chunkTime - _lastTime;
+
+    uint8_t varint[5];
+    uint8_t varintLength = 0;
+    do
+    {
+        varint[varintLength] = delta & 0x7F;
+        delta >>= 7;
+        if (delta != 0) varint[varintLength] |= 0x80;
+        varintLength++;
+    }
+    while (delta != 0);
+
+    if (_ring != NULL)
+    {
+        uint16_t size = 1 + varintLength + _chunkLength;
+        if (size > _ringSize)
+        {
+            _dropped++;
+            _chunkLength = 0;
+            return;
+        }
+        while (_ringSize - _used < size) _dropOldest();
+    }
+
+    _emit(header);
+    for (uint8_t i = 0; i < varintLength; i++) _emit(varint[i]);
+    for (uint8_t i = 0; i < _chunkLength; i++) _emit(_chunk[i]);
+
+    _lastTime = _chunkTime;
+    _chunkLength = 0;
+}
+
+/*
+ * Write the content of the RAM ring as a complete log.
+ * Return the number of bytes written.
+ */
+uint32_t Sim800LRecorder::dump(Print &out)
+{
+    flush();
+
+    uint32_t written = out.print(F("S8RL"));
+    written += out.write((uint8_t) RECORDER_VERSION);
+
+    if (_ring == NULL) return written;
+
+    for (uint16_t i = 0; i < _used; i++)
+    {
+        written += out.write(_ringAt(i));
+    }
+    return written;
+}
+
+/*
+ * Number of records lost because the ring was full
+ */
+uint32_t Sim800LRecorder::getDropped()
+{
+    return _dropped;
+}
+
+
+//
+//PRIVATE METHODS
+//
+void Sim800LRecorder::_emit(uint8_t c)
+{
+    if (_out != NULL)
+    {
+        _out->write(c);
+        return;
+    }
+
+    _ring[_head] = c;
+    _head = (_head + 1) % _ringSize;
+    _used++;
+}
+
+uint8_t Sim800LRecorder::_ringAt(uint16_t offset)
+{
+    return _ring[(_tail + offset) % _ringSize];
+}
+
+void Sim800LRecorder::_dropOldest()
+{
+    // The tail is always on a record header
+    uint16_t size = 1 + (_ringAt(0) & 0x7F) + 1;
+    uint16_t offset = 1;
+
+    while (_ringAt(offset) & 0x80) offset++;
+    size += offset;
+
+    // The delta of the new first record becomes relative to a dropped one,
+    // a replayer only uses it as the starting offset.
+    _tail = (_tail + size) % _ringSize;
+    _used -= size;
+    _dropped++;
+}
@@ -0,0 +1,70 @@
+/*
+ *  Sim800LRecorder
+ *
+ *  Records the traffic between the library and the Sim800L, with
+ *  timestamps, in a compact binary log. The log can be written to any
+ *  Print (Serial, an SD File...) or kept in a RAM ring that always holds
+ *  the most recent records.
+ *
+ *  LOG FORMAT
+ *		"S8RL" followed by the version byte, then a sequence of records:
+ *		header	1 byte	bit 7: 1 = sent to the module, 0 = received from it
+ *						bit 0-6: payload length - 1 (1..128 bytes)
+ *		delta	varint	ms elapsed since the previous record, 7 bits per byte,
+ *						least significant first, bit 7 set if more bytes follow
+ *		payload	length bytes
+ *
+ *  extras/replay/sim800l_replay.cpp plays a log back on the host.
+ *
+*/
+
+#ifndef Sim800LRecorder_h
+#define Sim800LRecorder_h
+#include "Arduino.h"
+
+#define RECORDER_VERSION		1
+#define RECORDER_CHUNK_SIZE		32		// bytes buffered before a record is emitted
+#define RECORDER_GAP			5		// ms of silence that closes a record
+
+#define RECORDER_RX				0
+#define RECORDER_TX				1
+
+class Sim800LRecorder
+{
+private:
+
+    Print *_out;
+    uint8_t *_ring;
+    uint16_t _ringSize;
+    uint16_t _head;
+    uint16_t _tail;
+    uint16_t _used;
+
+    uint8_t _chunk[RECORDER_CHUNK_SIZE];
+    uint8_t _chunkLength;
+    uint8_t _chunkDirection;
+    uint32_t _chunkTime;
+    uint32_t _lastTime;
+    uint32_t _dropped;
+
+    void _emit(uint8_t c);
+    void _dropOldest();
+    uint8_t _ringAt(uint16_t offset);
+
+public:
+
+    Sim800LRecorder(void);
+
+    void begin(Print &out);
+    void begin(uint8_t *ring, uint16_t size);
+    void end();
+
+    void record(uint8_t direction, uint8_t c);
+    void flush();
+
+    uint32_t dump(Print &out);
+    uint32_t getDropped();
+
+};
+
+#endif
@@ -0,0 +1,232 @@
+/*
+ *  Sim800LSignalLog
+ *
+ *  Ring of signal quality samples, see Sim800LSignalLog.h
+ *
+*/
+
+#include "Arduino.h"
+#include "Sim800LSignalLog.h"
+#if defined(__AVR__)
+#include <avr/eeprom.h>
+#endif
+
+#define SIGNAL_LOG_FREE		0xFF
+#define SIGNAL_LOG_LAP		0x80
+#define SIGNAL_LOG_BER_UNKNOWN	0x0F
+#define SIGNAL_LOG_TIME_MASK	0xFFFFFFUL
+
+Sim800LSignalLog::Sim800LSignalLog(void)
+{
+    _ring 		= NULL;
+    _eeprom 	= false;
+    _capacity 	= 0;
+    _head 		= 0;
+    _count 		= 0;
+}
+
+/*
+ * Keep the samples in ring, size / SIGNAL_LOG_SAMPLE_SIZE of them
+ */
+void Sim800LSignalLog::begin(uint8_t *ring, uint16_t size)
+{
+    _ring 		= ring;
+    _eeprom 	= false;
+    _base 		= 0;
+    _capacity 	= size / SIGNAL_LOG_SAMPLE_SIZE;
+    clear();
+}
+
+#if defined(__AVR__)
+/*
+ * Keep the samples in the EEPROM, from address to address + size.
+ * The samples of a log with the same address and size survive a restart.
+ */
+void Sim800LSignalLog::begin(uint16_t address, uint16_t size)
+{
+    _ring 		= NULL;
+    _eeprom 	= true;
+    _base 		= address + SIGNAL_LOG_HEADER_SIZE;
+    _capacity 	= size > SIGNAL_LOG_HEADER_SIZE ? (size - SIGNAL_LOG_HEADER_SIZE) / SIGNAL_LOG_SAMPLE_SIZE : 0;
+
+    uint8_t header[SIGNAL_LOG_HEADER_SIZE] = { 'S', 'Q', SIGNAL_LOG_VERSION, (uint8_t) size, (uint8_t) (size >> 8) };
+    bool valid = true;
+    for (uint8_t i = 0; i < SIGNAL_LOG_HEADER_SIZE; i++)
+    {
+        if (eeprom_read_byte((const uint8_t *) (address + i)) != header[i]) valid = false;
+    }
+
+    if (valid)
+    {
+        _load();
+        return;
+    }
+
+    for (uint8_t i = 0; i < SIGNAL_LOG_HEADER_SIZE; i++)
+    {
+        eeprom_update_byte((uint8_t *) (address + i), header[i]);
+    }
+    clear();
+}
+#endif
+
+void Sim800LSignalLog::end()
+{
+    _ring = NULL;
+    _eeprom = false;
+    _capacity = 0;
+    _count = 0;
+}
+
+/*
+ * Forget every sample, the time starts again from 0
+ */
+void Sim800LSignalLog::clear()
+{
+    for (uint16_t i = 0; i < _capacity; i++)
+    {
+        _write(i * SIGNAL_LOG_SAMPLE_SIZE + 3, SIGNAL_LOG_FREE);
+    }
+    _head = 0;
+    _count = 0;
+    _lap = 0;
+    _timeBase = millis() / 1000;
+}
+
+/*
+ * Store a sample with the values of +CSQ and +CREG, the oldest one is
+ * replaced when the ring is full.
+ */
+void Sim800LSignalLog::add(uint8_t rssi, uint8_t ber, uint8_t registration)
+{
+    if (_capacity == 0) return;
+
+    uint16_t offset = _head * SIGNAL_LOG_SAMPLE_SIZE;
+    uint32_t time = (millis() / 1000 - _timeBase) & SIGNAL_LOG_TIME_MASK;
+
+    if (ber > 7) ber = SIGNAL_LOG_BER_UNKNOWN;
+    if (rssi > 31) rssi = SIGNAL_LOG_UNKNOWN;
+
+    _write(offset, time);
+    _write(offset + 1, time >> 8);
+    _write(offset + 2, time >> 16);
+    _write(offset + 4, (ber << 4) | (registration & 0x0F));
+    // Last, a sample cut by a power loss stays free or keeps the old lap
+    _write(offset + 3, (_lap ? SIGNAL_LOG_LAP : 0) | rssi);
+
+    if (++_head == _capacity)
+    {
+        _head = 0;
+        _lap ^= 1;
+    }
+    if (_count < _capacity) _count++;
+}
+
+uint16_t Sim800LSignalLog::count()
+{
+    return _count;
+}
+
+uint16_t Sim800LSignalLog::capacity()
+{
+    return _capacity;
+}
+
+/*
+ * Sample at index, 0 is the oldest one and count() - 1 the newest.
+ * Return false when index is out of the log.
+ */
+bool Sim800LSignalLog::get(uint16_t index, SignalSample &sample)
+{
+    if (index >= _count) return false;
+
+    uint16_t offset = ((_head + _capacity - _count + index) % _capacity) * SIGNAL_LOG_SAMPLE_SIZE;
+
+    sample.time = _read(offset) | ((uint32_t) _read(offset + 1) << 8) | ((uint32_t) _read(offset + 2) << 16);
+    sample.rssi = _read(offset + 3) & ~SIGNAL_LOG_LAP;
+    uint8_t status = _read(offset + 4);
+    sample.ber = status >> 4;
+    if (sample.ber == SIGNAL_LOG_BER_UNKNOWN) sample.ber = SIGNAL_LOG_UNKNOWN;
+    sample.registration = status & 0x0F;
+    return true;
+}
+
+/*
+ * Write the samples, oldest first, as CSV lines "time,rssi,ber,registration".
+ * Return the number of bytes written.
+ */
+uint32_t Sim800LSignalLog::dump(Print &out)
+{
+    SignalSample sample;
+    uint32_t written = out.println(F("time,rssi,ber,registration"));
+
+    for (uint16_t i = 0; get(i, sample); i++)
+    {
+        written += out.print(sample.time);
+        written += out.print(',');
+        written += out.print(sample.rssi);
+        written += out.print(',');
+        written += out.print(sample.ber);
+        written += out.print(',');
+        written += out.println(sample.registration);
+    }
+    return written;
+}
+
+
+//
+//PRIVATE METHODS
+//
+uint8_t Sim800LSignalLog::_read(uint16_t offset)
+{
+#if defined(__AVR__)
+    if (_eeprom) return eeprom_read_byte((const uint8_t *) (_base + offset));
+#endif
+    return _ring[offset];
+}
+
+void Sim800LSignalLog::_write(uint16_t offset, uint8_t value)
+{
+#if defined(__AVR__)
+    if (_eeprom)
+    {
+        eeprom_update_byte((uint8_t *) (_base + offset), value);
+        return;
+    }
+#endif
+    _ring[offset] = value;
+}
+
+// Find the newest sample of an EEPROM log from the lap bits
+void Sim800LSignalLog::_load()
+{
+    _head = 0;
+    _count = 0;
+    _lap = 0;
+    _timeBase = millis() / 1000;
+
+    if (_capacity == 0) return;
+
+    uint8_t first = _read(3);
+    if (first == SIGNAL_LOG_FREE) return;
+
+    uint8_t lap = first & SIGNAL_LOG_LAP;
+    _count = _capacity;
+    _lap = lap ? 0 : 1;
+    for (uint16_t i = 1; i < _capacity; i++)
+    {
+        uint8_t rssi = _read(i * SIGNAL_LOG_SAMPLE_SIZE + 3);
+        if (rssi == SIGNAL_LOG_FREE || (rssi & SIGNAL_LOG_LAP) != lap)
+        {
+            _head = i;
+            if (rssi == SIGNAL_LOG_FREE) _count = i;
+            _lap = lap ? 1 : 0;
+            break;
+        }
+    }
+
+    // The time goes on after the newest sample
+    SignalSample newest;
+    get(_count - 1, newest);
+    _timeBase -= newest.time + 1;
+}
@@ -0,0 +1,80 @@
+/*
+ *  Sim800LSignalLog
+ *
+ *  History of the radio conditions: timestamped RSSI, BER and registration
+ *  status in a fixed size ring, in RAM or (AVR) in EEPROM. When the ring is
+ *  full a new sample replaces the oldest one. Sim800L::setSignalLog() fills
+ *  it from poll().
+ *
+ *  SAMPLE FORMAT
+ *		SIGNAL_LOG_SAMPLE_SIZE bytes:
+ *		time	3 bytes	seconds since begin(), least significant first
+ *		rssi	1 byte	bit 7: lap, flips at each turn of the ring
+ *						bit 0-6: +CSQ rssi, 0..31 or 99
+ *		status	1 byte	bit 4-7: +CSQ ber, 0..7, 15 for 99
+ *						bit 0-3: +CREG status
+ *		A free slot has 0xFF as rssi byte.
+ *
+ *  EEPROM LAYOUT
+ *		"SQ", the version byte and the size (2 bytes), then the samples.
+ *		The newest sample is found from the lap bits, so every byte is
+ *		written once per turn of the ring. After a restart the time goes on
+ *		from the newest sample, it does not count the time the board was off.
+ *
+*/
+
+#ifndef Sim800LSignalLog_h
+#define Sim800LSignalLog_h
+#include "Arduino.h"
+
+#define SIGNAL_LOG_VERSION		1
+#define SIGNAL_LOG_SAMPLE_SIZE	5
+#define SIGNAL_LOG_HEADER_SIZE	5		// EEPROM only
+#define SIGNAL_LOG_UNKNOWN		99		// rssi or ber not detectable
+
+struct SignalSample {
+    uint32_t time;              // seconds since begin(), 24 bits
+    uint8_t rssi;               // 0 (-115 dBm or less) .. 31 (-52 dBm or more), 99 unknown
+    uint8_t ber;                // 0..7 RXQUAL, 99 unknown
+    uint8_t registration;       // NetworkRegistrationStatus
+} ;
+
+class Sim800LSignalLog
+{
+private:
+
+    uint8_t *_ring;
+    bool _eeprom;
+    uint16_t _base;
+    uint16_t _capacity;
+    uint16_t _head;
+    uint16_t _count;
+    uint8_t _lap;
+    uint32_t _timeBase;
+
+    uint8_t _read(uint16_t offset);
+    void _write(uint16_t offset, uint8_t value);
+    void _load();
+
+public:
+
+    Sim800LSignalLog(void);
+
+    void begin(uint8_t *ring, uint16_t size);
+#if defined(__AVR__)
+    void begin(uint16_t address, uint16_t size);
+#endif
+    void end();
+    void clear();
+
+    void add(uint8_t rssi, uint8_t ber, uint8_t registration);
+
+    uint16_t count();
+    uint16_t capacity();
+    bool get(uint16_t index, SignalSample &sample);
+
+    uint32_t dump(Print &out);
+
+};
+
+#endif
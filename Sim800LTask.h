@@ -0,0 +1,47 @@
+/*
+ *  Sim800LTask
+ *
+ *  Resumable procedures in the style of protothreads, run by Sim800L::poll().
+ *
+ *  A task is a function returning true once it is over. Between TASK_BEGIN
+ *  and TASK_END it can give the CPU back with TASK_YIELD, TASK_WAIT_UNTIL or
+ *  TASK_DELAY: the next call resumes right after that point.
+ *
+ *  LIMITATIONS
+ *		Local variables are not kept across a wait, keep the state in the
+ *		Sim800LTask or in members. Only one TASK_ macro per source line, and
+ *		no switch statement around a wait.
+ *
+*/
+
+#ifndef Sim800LTask_h
+#define Sim800LTask_h
+#include "Arduino.h"
+
+struct Sim800LTask {
+    uint16_t line;              // where to resume, 0 = from the start
+    uint32_t timer;
+    uint8_t retries;
+    bool running;
+    bool success;
+} ;
+
+#define TASK_BEGIN(task)				switch ((task).line) { case 0:
+
+#define TASK_END(task)					} (task).line = 0; return true
+
+#define TASK_EXIT(task, ok)				do { (task).success = (ok); (task).line = 0; return true; } while (0)
+
+#define TASK_YIELD(task)				do { (task).line = __LINE__; return false; case __LINE__:; } while (0)
+
+#define TASK_WAIT_UNTIL(task, condition) \
+    do { (task).line = __LINE__; case __LINE__: if (!(condition)) return false; } while (0)
+
+#define TASK_DELAY(task, ms) \
+    do { (task).timer = millis(); (task).line = __LINE__; case __LINE__: if (millis() - (task).timer < (uint32_t) (ms)) return false; } while (0)
+
+// Run the child task until it is over
+#define TASK_SPAWN(task, child, call) \
+    do { (child).line = 0; (task).line = __LINE__; case __LINE__: if (!(call)) return false; } while (0)
+
+#endif
@@ -0,0 +1,77 @@
+/* 
+ *  This library was written by Vittorio Esposito
+ *    https://github.com/VittorioEsposito
+ *
+ *  Designed to work with the GSM Sim800L.
+ *
+ *  ENG
+ *    This library uses SoftwareSerial, you can define RX and TX pins
+ *    in the header "Sim800L.h", by default pins are RX=10 and TX=11.
+ *    Be sure that GND is connected to arduino too. 
+ *    You can also change the RESET_PIN as you prefer.
+ *
+ *   DEFAULT PINOUT: 
+ *        _____________________________
+ *       |  ARDUINO UNO >>>   Sim800L  |
+ *        -----------------------------
+ *            GND      >>>   GND
+ *        RX  10       >>>   TX    
+ *        TX  11       >>>   RX
+ *       RESET 2       >>>   RST 
+ *                 
+ *   POWER SOURCE 4.2V >>> VCC
+ *
+ *  This example answers every incoming call and hangs up after 10 seconds,
+ *  without polling the module with AT+CPAS.
+ *
+*/
+
+#include <Sim800L.h>
+#include <SoftwareSerial.h>               
+
+#define RX  10
+#define TX  11
+
+Sim800L GSM(RX, TX);
+
+unsigned long connectedAt = 0;
+
+void incomingCall(String number)
+{
+  Serial.print("Incoming call from ");
+  Serial.println(number);
+  GSM.answerCall();
+}
+
+void callConnected()
+{
+  Serial.println("Connected");
+  connectedAt = millis();
+}
+
+void callEnded()
+{
+  Serial.println("Call ended");
+  connectedAt = 0;
+}
+
+void setup() {
+  Serial.begin(9600);
+  GSM.begin(4800);
+  GSM.onIncomingCall = incomingCall;
+  GSM.onCallConnected = callConnected;
+  GSM.onCallEnded = callEnded;
+  while(!GSM.prepareForCallEvents())
+  {
+    delay(1000);
+  }
+}
+
+void loop() {
+  GSM.poll();
+
+  if(connectedAt != 0 && millis() - connectedAt > 10000)
+  {
+    GSM.hangoffCall();
+  }
+}
@@ -0,0 +1,169 @@
+/* 
+ *  This library was written by Vittorio Esposito
+ *    https://github.com/VittorioEsposito
+ *
+ *  Designed to work with the GSM Sim800L.
+ *
+ *  ENG
+ *    This library uses SoftwareSerial, you can define RX and TX pins
+ *    in the header "Sim800L.h", by default pins are RX=10 and TX=11.
+ *    Be sure that GND is connected to arduino too. 
+ *    You can also change the RESET_PIN as you prefer.
+ *
+ *   DEFAULT PINOUT: 
+ *        _____________________________
+ *       |  ARDUINO UNO >>>   Sim800L  |
+ *        -----------------------------
+ *            GND      >>>   GND
+ *        RX  10       >>>   TX    
+ *        TX  11       >>>   RX
+ *       RESET 2       >>>   RST 
+ *                 
+ *   POWER SOURCE 4.2V >>> VCC
+ *
+ *  This example calls, one at a time, the library methods the other
+ *  examples rely on (signalQuality, readSms, checkForSMS, calculateLocation,
+ *  RTCtime, sendSms...) and prints one line per call:
+ *
+ *    ms      time taken
+ *    heap    heap size after the operation, growing runs mean a leak
+ *    peak    highest heap size reached during the operation
+ *    holes   blocks in the free list and their total size: fragmentation
+ *    block   largest free block, the longest String that can still be made
+ *    free    memory between the heap and the stack
+ *    stack   deepest stack reached during the operation
+ *
+ *  Peaks are found by painting the free memory before each operation and
+ *  looking for what was overwritten, so they are a lower bound.
+ *
+ *  Wire the board to sim800l_replay (extras/replay) instead of the module
+ *  to run the same recorded session before and after a change.
+ *
+ *  The memory columns read the layout of the AVR heap and stack: on other
+ *  boards only the time is measured and they print "unsupported".
+ *
+*/
+
+#include <Sim800L.h>
+#include <SoftwareSerial.h>               
+
+#define RX  10
+#define TX  11
+
+#define PAINT       0xA5
+#define SEND_SMS    0                     // 1 to include sendSms, it costs an sms
+
+Sim800L GSM(RX, TX);
+
+#if SEND_SMS
+char number[] = "+393331234567";
+char text[] = "memory profile";
+#endif
+
+#if defined(__AVR__)
+// avr-libc allocator state
+struct __freelist {
+  size_t sz;
+  struct __freelist *nx;
+};
+extern struct __freelist *__flp;
+extern char __heap_start;
+extern char *__brkval;
+
+uint8_t *paintStart;
+uint8_t *paintEnd;
+
+uint8_t *heapEnd()
+{
+  return (uint8_t *) (__brkval == 0 ? &__heap_start : __brkval);
+}
+
+// Fill the memory between the heap and the stack
+void paint()
+{
+  uint8_t marker;
+  paintStart = heapEnd();
+  paintEnd = &marker - 64;
+  for (uint8_t *p = paintStart; p < paintEnd; p++) *p = PAINT;
+}
+
+void report(const __FlashStringHelper *name, unsigned long ms)
+{
+  uint8_t marker;
+
+  uint8_t *heapPeak = paintStart;
+  while (heapPeak < paintEnd && *heapPeak != PAINT) heapPeak++;
+  uint8_t *stackPeak = paintEnd - 1;
+  while (stackPeak > heapPeak && *stackPeak != PAINT) stackPeak--;
+
+  size_t holes = 0;
+  size_t holesSize = 0;
+  size_t largest = &marker - heapEnd();
+  for (struct __freelist *f = __flp; f != NULL; f = f->nx)
+  {
+    holes++;
+    holesSize += f->sz + sizeof(size_t);
+    if (f->sz > largest) largest = f->sz;
+  }
+
+  Serial.print(name);
+  Serial.print(F("\t"));
+  Serial.print(ms);
+  Serial.print(F("\t"));
+  Serial.print(heapEnd() - (uint8_t *) &__heap_start);
+  Serial.print(F("\t"));
+  Serial.print(heapPeak - (uint8_t *) &__heap_start);
+  Serial.print(F("\t"));
+  Serial.print(holes);
+  Serial.print(F("/"));
+  Serial.print(holesSize);
+  Serial.print(F("\t"));
+  Serial.print(largest);
+  Serial.print(F("\t"));
+  Serial.print(&marker - heapEnd());
+  Serial.print(F("\t"));
+  Serial.println(RAMEND - (size_t) stackPeak);
+}
+#else
+void paint()
+{
+}
+
+void report(const __FlashStringHelper *name, unsigned long ms)
+{
+  Serial.print(name);
+  Serial.print(F("\t"));
+  Serial.print(ms);
+  Serial.println(F("\tunsupported"));
+}
+#endif
+
+#define PROFILE(name, operation) \
+  do { paint(); unsigned long start = millis(); operation; report(F(name), millis() - start); } while (0)
+
+void setup() {
+  Serial.begin(9600);
+  Serial.println(F("operation\tms\theap\tpeak\tholes\tblock\tfree\tstack"));
+
+  PROFILE("begin", GSM.begin(4800));
+}
+
+void loop() {
+  int day, month, year, hour, minute, second;
+
+  PROFILE("signalQuality", GSM.signalQuality());
+  PROFILE("getProductInfo", GSM.getProductInfo());
+  PROFILE("readSms", GSM.readSms(1));
+  PROFILE("getNumberSms", GSM.getNumberSms(1));
+  PROFILE("checkForSMS", GSM.checkForSMS());
+  PROFILE("calculateLocation", GSM.calculateLocation());
+  PROFILE("dateNet", GSM.dateNet());
+  PROFILE("RTCtime", GSM.RTCtime(&day, &month, &year, &hour, &minute, &second));
+#if SEND_SMS
+  PROFILE("sendSms", GSM.sendSms(number, text));
+#endif
+  PROFILE("poll", GSM.poll());
+
+  Serial.println();
+  delay(10000);
+}
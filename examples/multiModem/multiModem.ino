@@ -0,0 +1,66 @@
+/* 
+ *  This library was written by Vittorio Esposito
+ *    https://github.com/VittorioEsposito
+ *
+ *  Designed to work with the GSM Sim800L.
+ *
+ *  ENG
+ *    This example drives two Sim800L from the same Arduino with
+ *    Sim800LManager: outgoing sms are spread over both SIMs and
+ *    the events of both modules are reported with the module index.
+ *
+ *   PINOUT: 
+ *        _____________________________
+ *       |  ARDUINO UNO >>>   Sim800L  |
+ *        -----------------------------
+ *            GND      >>>   GND (both)
+ *        RX  10       >>>   TX  (first)
+ *        TX  11       >>>   RX  (first)
+ *        RX  8        >>>   TX  (second)
+ *        TX  9        >>>   RX  (second)
+ *                 
+ *   POWER SOURCE 4.2V >>> VCC
+ *
+*/
+
+#include <Sim800L.h>
+#include <Sim800LManager.h>
+#include <SoftwareSerial.h>               
+
+Sim800L first(10, 11);
+Sim800L second(8, 9);
+Sim800LManager modems;
+
+void incomingCall(uint8_t modem, String number)
+{
+  Serial.print("Call on module ");
+  Serial.print(modem);
+  Serial.print(" from ");
+  Serial.println(number);
+}
+
+void setup() {
+  Serial.begin(9600);
+  first.begin(4800);
+  second.begin(4800);
+
+  modems.add(first);
+  modems.add(second);
+  modems.onIncomingCall = incomingCall;
+
+  for(uint8_t i = 0; i < modems.count(); i++)
+  {
+    modems.select(i).prepareForCallEvents();
+  }
+
+  for(uint8_t i = 0; i < 4; i++)
+  {
+    int8_t sentBy = modems.sendSms("2926451386", "Testing Sms");
+    Serial.print("Sent by module ");
+    Serial.println(sentBy);
+  }
+}
+
+void loop() {
+  modems.poll();
+}
@@ -0,0 +1,97 @@
+#!/bin/sh
+#
+#  Report flash and RAM used by the library for each feature configuration.
+#
+#  Needs arduino-cli with the core of the board installed.
+#
+#  USAGE
+#		extras/footprint/footprint.sh [fqbn]		(default arduino:avr:uno)
+#
+
+FQBN=${1:-arduino:avr:uno}
+LIBRARY=$(cd "$(dirname "$0")/../.." && pwd)
+SKETCH=$(mktemp -d)/footprint
+mkdir -p "$SKETCH"
+
+# Links begin() and poll() plus, for every enabled feature, one of its methods
+cat > "$SKETCH/footprint.ino" <<'SKETCH'
+#include <Sim800L.h>
+
+Sim800L GSM;
+char number[] = "0";
+char text[] = "0";
+
+void setup() {
+  GSM.begin();
+#if SIM800L_ENABLE_SMS
+  GSM.sendSms(number, text);
+  GSM.checkForSMS();
+#endif
+#if SIM800L_ENABLE_CALL
+  GSM.prepareForCallEvents();
+#endif
+#if SIM800L_ENABLE_DTMF
+  GSM.setDtmfDetection(true);
+#endif
+#if SIM800L_ENABLE_LOCATION
+  GSM.calculateLocation();
+#endif
+#if SIM800L_ENABLE_RTC
+  GSM.updateRtc(0);
+#endif
+#if SIM800L_ENABLE_PIN
+  GSM.PINIsReady();
+#endif
+#if SIM800L_ENABLE_OPERATOR
+  GSM.getOperator();
+#endif
+#if SIM800L_ENABLE_CELL
+  GSM.setCellMonitoring(60000);
+#endif
+#if SIM800L_ENABLE_WATCHDOG
+  GSM.setWatchdog(60000);
+#endif
+#if SIM800L_ENABLE_FTP
+  GSM.ftpPut("/", "log", Serial);
+#endif
+#if SIM800L_ENABLE_USSD
+  GSM.sendUssd("*100#");
+#endif
+#if SIM800L_ENABLE_SIGNAL_LOG
+  static uint8_t ring[50];
+  static Sim800LSignalLog signalLog;
+  signalLog.begin(ring, sizeof(ring));
+  GSM.setSignalLog(&signalLog, 60000);
+#endif
+}
+
+void loop() {
+  GSM.poll();
+}
+SKETCH
+
+FEATURES="CALL SMS LOCATION RTC PIN OPERATOR RECORDER CELL WATCHDOG FTP SIGNAL_LOG DTMF USSD"
+
+footprint() {
+    NAME=$1
+    FLAGS=$2
+    OUTPUT=$(arduino-cli compile --fqbn "$FQBN" --library "$LIBRARY" \
+        --build-property "compiler.cpp.extra_flags=$FLAGS" "$SKETCH" 2>&1)
+    FLASH=$(echo "$OUTPUT" | sed -n 's/^Sketch uses \([0-9]*\) bytes.*/\1/p')
+    RAM=$(echo "$OUTPUT" | sed -n 's/^Global variables use \([0-9]*\) bytes.*/\1/p')
+    printf "%-20s %8s %8s\n" "$NAME" "${FLASH:-error}" "${RAM:-error}"
+}
+
+printf "%-20s %8s %8s\n" "configuration" "flash" "ram"
+footprint "all features" ""
+for FEATURE in $FEATURES; do
+    footprint "no $FEATURE" "-DSIM800L_ENABLE_$FEATURE=0"
+done
+
+SMS_ONLY=""
+for FEATURE in $FEATURES; do
+    [ "$FEATURE" = "SMS" ] || SMS_ONLY="$SMS_ONLY -DSIM800L_ENABLE_$FEATURE=0"
+done
+footprint "sms only" "$SMS_ONLY"
+
+rm -rf "$(dirname "$SKETCH")"
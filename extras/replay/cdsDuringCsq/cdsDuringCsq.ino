@@ -0,0 +1,43 @@
+/*
+ *  Replay case: a status report (+CDS) arrives in the middle of the answer
+ *  of a blocking command.
+ *
+ *  The sms sent with sendSms(pdu) gets the message reference 42, then its
+ *  status report comes between the echo of AT+CSQ and its +CSQ line. The
+ *  report must reach onDeliveryReport, not be swallowed by signalQuality()
+ *  and later reported as DELIVERY_STATUS_TIME_OUT.
+ *
+ *  Wire the board to the host as for any replay (RX 10, TX 11), then
+ *		sim800l_replay play extras/replay/cdsDuringCsq/cdsDuringCsq.s8rl <device> 4800
+ *  and read PASS or FAIL on Serial.
+ *
+*/
+
+#include <Sim800L.h>
+#include <SoftwareSerial.h>
+
+#define RX  10
+#define TX  11
+
+Sim800L GSM(RX, TX);
+int status = -1;
+
+void deliveryReport(const SmsDeliveryReport &report)
+{
+  if (report.reference == 42) status = report.status;
+}
+
+void setup() {
+  Serial.begin(9600);
+  GSM.begin(4800);
+  GSM.onDeliveryReport = deliveryReport;
+
+  GSM.sendSms(String("0011000B913356108867F80000AA01C1"));
+  GSM.signalQuality();
+  GSM.checkDeliveryTimeouts();
+
+  Serial.println(status == 0 ? F("PASS") : F("FAIL"));
+}
+
+void loop() {
+}
@@ -0,0 +1,279 @@
+/*
+ *  sim800l_replay
+ *
+ *  Host tool for the logs written by Sim800LRecorder.
+ *
+ *  The board running the library is connected to the host with a USB-serial
+ *  adapter in place of the Sim800L, and the tool plays the module side of the
+ *  recording: bytes the module sent are written back with their original
+ *  timing (or as fast as possible with --fast), bytes the library sent are
+ *  awaited and compared with the recording. At the end it reports how long
+ *  the library took to answer, so parser and driver changes can be compared
+ *  on real traffic.
+ *
+ *  BUILD
+ *		g++ -O2 -o sim800l_replay sim800l_replay.cpp
+ *
+ *  USAGE
+ *		sim800l_replay dump <log>
+ *		sim800l_replay play <log> <serial device> [baud] [--fast]
+ *
+*/
+
+#include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+struct Record
+{
+    bool tx;                    // sent by the library to the module
+    uint32_t delta;             // ms since the previous record
+    std::vector<uint8_t> data;
+};
+
+static bool loadLog(const char *path, std::vector<Record> &records)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        perror(path);
+        return false;
+    }
+
+    char magic[5];
+    if (fread(magic, 1, 5, file) != 5 || memcmp(magic, "S8RL", 4) != 0 || magic[4] != 1)
+    {
+        fprintf(stderr, "%s: not a Sim800LRecorder log\n", path);
+        fclose(file);
+        return false;
+    }
+
+    int header;
+    while ((header = fgetc(file)) != EOF)
+    {
+        Record record;
+        record.tx = (header & 0x80) != 0;
+        record.delta = 0;
+
+        int c;
+        uint8_t shift = 0;
+        do
+        {
+            c = fgetc(file);
+            if (c == EOF) break;
+            record.delta |= (uint32_t) (c & 0x7F) << shift;
+            shift += 7;
+        }
+        while (c & 0x80);
+
+        record.data.resize((header & 0x7F) + 1);
+        if (c == EOF || fread(record.data.data(), 1, record.data.size(), file) != record.data.size())
+        {
+            fprintf(stderr, "%s: truncated record, ignored\n", path);
+            break;
+        }
+        records.push_back(record);
+    }
+
+    fclose(file);
+    return true;
+}
+
+static void printEscaped(const std::vector<uint8_t> &data)
+{
+    for (size_t i = 0; i < data.size(); i++)
+    {
+        uint8_t c = data[i];
+        if (c == '\r')      printf("\\r");
+        else if (c == '\n') printf("\\n");
+        else if (c == 0x1A) printf("<ctrl-z>");
+        else if (c < 0x20 || c > 0x7E) printf("\\x%02X", c);
+        else putchar(c);
+    }
+}
+
+static int dump(const std::vector<Record> &records)
+{
+    uint64_t time = 0;
+
+    for (size_t i = 0; i < records.size(); i++)
+    {
+        time += records[i].delta;
+        printf("%10llu %s ", (unsigned long long) time, records[i].tx ? ">>" : "<<");
+        printEscaped(records[i].data);
+        putchar('\n');
+    }
+    return 0;
+}
+
+static uint64_t nowMs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static speed_t toSpeed(long baud)
+{
+    switch (baud)
+    {
+    case 1200:   return B1200;
+    case 2400:   return B2400;
+    case 4800:   return B4800;
+    case 9600:   return B9600;
+    case 19200:  return B19200;
+    case 38400:  return B38400;
+    case 57600:  return B57600;
+    case 115200: return B115200;
+    }
+    return 0;
+}
+
+static int openPort(const char *device, long baud)
+{
+    speed_t speed = toSpeed(baud);
+    if (speed == 0)
+    {
+        fprintf(stderr, "unsupported baud rate %ld\n", baud);
+        return -1;
+    }
+
+    int fd = open(device, O_RDWR | O_NOCTTY);
+    if (fd < 0)
+    {
+        perror(device);
+        return -1;
+    }
+
+    struct termios tty;
+    tcgetattr(fd, &tty);
+    cfmakeraw(&tty);
+    cfsetispeed(&tty, speed);
+    cfsetospeed(&tty, speed);
+    tty.c_cflag |= CLOCAL | CREAD;
+    tcsetattr(fd, TCSANOW, &tty);
+    tcflush(fd, TCIOFLUSH);
+    return fd;
+}
+
+// Wait for the library to send what it sent during the recording
+static bool expect(int fd, const std::vector<uint8_t> &data, uint32_t timeout, size_t &mismatches)
+{
+    uint64_t deadline = nowMs() + timeout;
+
+    for (size_t i = 0; i < data.size(); i++)
+    {
+        uint8_t c;
+        for (;;)
+        {
+            int64_t left = (int64_t) (deadline - nowMs());
+            struct pollfd pfd = { fd, POLLIN, 0 };
+            if (left <= 0 || poll(&pfd, 1, (int) left) <= 0) return false;
+            if (read(fd, &c, 1) == 1) break;
+        }
+        if (c != data[i]) mismatches++;
+    }
+    return true;
+}
+
+static int play(const std::vector<Record> &records, const char *device, long baud, bool fast)
+{
+    int fd = openPort(device, baud);
+    if (fd < 0) return 1;
+
+    size_t mismatches = 0;
+    size_t timeouts = 0;
+    size_t answers = 0;
+    uint64_t answerTime = 0;
+    uint64_t worstAnswer = 0;
+    uint64_t start = nowMs();
+    uint64_t lastModemByte = 0;
+
+    for (size_t i = 0; i < records.size(); i++)
+    {
+        const Record &record = records[i];
+
+        if (record.tx)
+        {
+            // The first byte of a command following a module answer measures
+            // how long the library took to process it
+            bool answering = lastModemByte != 0;
+
+            if (!expect(fd, record.data, fast ? 10000 : record.delta + 10000, mismatches))
+            {
+                fprintf(stderr, "record %zu: timeout waiting for the library\n", i);
+                timeouts++;
+            }
+            else if (answering)
+            {
+                uint64_t elapsed = nowMs() - lastModemByte;
+                answers++;
+                answerTime += elapsed;
+                if (elapsed > worstAnswer) worstAnswer = elapsed;
+            }
+            lastModemByte = 0;
+        }
+        else
+        {
+            if (!fast && i > 0) usleep(record.delta * 1000);
+            if (write(fd, record.data.data(), record.data.size()) < 0)
+            {
+                perror(device);
+                close(fd);
+                return 1;
+            }
+            tcdrain(fd);
+            lastModemByte = nowMs();
+        }
+    }
+
+    close(fd);
+
+    printf("records:     %zu\n", records.size());
+    printf("total time:  %llu ms\n", (unsigned long long) (nowMs() - start));
+    printf("timeouts:    %zu\n", timeouts);
+    printf("mismatches:  %zu bytes\n", mismatches);
+    if (answers > 0)
+    {
+        printf("answer time: %llu ms average, %llu ms worst over %zu answers\n",
+               (unsigned long long) (answerTime / answers), (unsigned long long) worstAnswer, answers);
+    }
+    return timeouts == 0 && mismatches == 0 ? 0 : 2;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3)
+    {
+        fprintf(stderr, "usage: %s dump <log>\n", argv[0]);
+        fprintf(stderr, "       %s play <log> <serial device> [baud] [--fast]\n", argv[0]);
+        return 1;
+    }
+
+    std::vector<Record> records;
+    if (!loadLog(argv[2], records)) return 1;
+
+    if (strcmp(argv[1], "dump") == 0) return dump(records);
+
+    if (strcmp(argv[1], "play") == 0 && argc >= 4)
+    {
+        long baud = 9600;
+        bool fast = false;
+        for (int i = 4; i < argc; i++)
+        {
+            if (strcmp(argv[i], "--fast") == 0) fast = true;
+            else baud = atol(argv[i]);
+        }
+        return play(records, argv[3], baud, fast);
+    }
+
+    fprintf(stderr, "unknown command %s\n", argv[1]);
+    return 1;
+}